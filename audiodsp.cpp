@@ -0,0 +1,239 @@
+#include "audiodsp.h"
+#include <SDL2/SDL.h>
+#undef main
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AUDIODSP_X86
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AUDIODSP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define AUDIODSP_TARGET(isa)
+#endif
+#endif
+
+namespace AudioDsp {
+
+namespace {
+
+// 软削波：阈值以内保持线性，超出部分用tanh的有理近似压缩，输出不超过1
+constexpr float kClipKnee = 0.8f;
+constexpr float kClipRange = 1.0f - kClipKnee;
+
+inline float softClip(float x)
+{
+    float a = std::fabs(x);
+    if(a <= kClipKnee)
+        return x;
+    float over = std::min((a - kClipKnee) / kClipRange,3.0f);
+    float shaped = over * (27.0f + over * over) / (27.0f + 9.0f * over * over);
+    return std::copysign(kClipKnee + kClipRange * shaped,x);
+}
+
+// 以下实现按样本处理：n个交错样本，音量从gain开始每个样本增加step。
+// 同一帧内各声道的音量只差几个step，远低于可闻程度，换来无需按帧展开的向量化
+void renderScalar(const float* in, void* out, int n, float gain, float step, OutputFormat format)
+{
+    int16_t* s16 = static_cast<int16_t*>(out);
+    float* f32 = static_cast<float*>(out);
+    for(int i = 0; i < n; ++i){
+        float v = softClip(in[i] * gain);
+        if(format == OutputFormat::S16)
+            s16[i] = static_cast<int16_t>(std::lrint(v * 32767.0f));
+        else
+            f32[i] = v;
+        gain += step;
+    }
+}
+
+inline void* advance(void* out, int samples, OutputFormat format)
+{
+    if(format == OutputFormat::S16)
+        return static_cast<int16_t*>(out) + samples;
+    return static_cast<float*>(out) + samples;
+}
+
+#ifdef AUDIODSP_X86
+
+AUDIODSP_TARGET("sse2")
+inline __m128 softClipSse2(__m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 sign = _mm_and_ps(x,signMask);
+    __m128 a = _mm_andnot_ps(signMask,x);
+    __m128 over = _mm_min_ps(_mm_mul_ps(_mm_max_ps(_mm_sub_ps(a,_mm_set1_ps(kClipKnee)),_mm_setzero_ps()),
+                                        _mm_set1_ps(1.0f / kClipRange)),_mm_set1_ps(3.0f));
+    __m128 o2 = _mm_mul_ps(over,over);
+    __m128 shaped = _mm_div_ps(_mm_mul_ps(over,_mm_add_ps(_mm_set1_ps(27.0f),o2)),
+                               _mm_add_ps(_mm_set1_ps(27.0f),_mm_mul_ps(_mm_set1_ps(9.0f),o2)));
+    __m128 y = _mm_add_ps(_mm_min_ps(a,_mm_set1_ps(kClipKnee)),_mm_mul_ps(_mm_set1_ps(kClipRange),shaped));
+    return _mm_or_ps(y,sign);
+}
+
+AUDIODSP_TARGET("sse2")
+void renderSse2(const float* in, void* out, int n, float gain, float step, OutputFormat format)
+{
+    int i = 0;
+    int16_t* s16 = static_cast<int16_t*>(out);
+    float* f32 = static_cast<float*>(out);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    // 两个向量的音量，每轮各前进8个step
+    __m128 g0 = _mm_add_ps(_mm_set1_ps(gain),_mm_mul_ps(_mm_set1_ps(step),_mm_setr_ps(0,1,2,3)));
+    __m128 g1 = _mm_add_ps(g0,_mm_set1_ps(4 * step));
+    const __m128 inc = _mm_set1_ps(8 * step);
+    for(; i + 8 <= n; i += 8){
+        __m128 v0 = softClipSse2(_mm_mul_ps(_mm_loadu_ps(in + i),g0));
+        __m128 v1 = softClipSse2(_mm_mul_ps(_mm_loadu_ps(in + i + 4),g1));
+        if(format == OutputFormat::S16){
+            __m128i p = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(v0,scale)),
+                                        _mm_cvtps_epi32(_mm_mul_ps(v1,scale)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(s16 + i),p);
+        }else{
+            _mm_storeu_ps(f32 + i,v0);
+            _mm_storeu_ps(f32 + i + 4,v1);
+        }
+        g0 = _mm_add_ps(g0,inc);
+        g1 = _mm_add_ps(g1,inc);
+    }
+    // 剩余不足一轮的样本
+    if(i < n)
+        renderScalar(in + i,advance(out,i,format),n - i,gain + step * i,step,format);
+}
+
+AUDIODSP_TARGET("avx2")
+inline __m256 softClipAvx2(__m256 x)
+{
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 sign = _mm256_and_ps(x,signMask);
+    __m256 a = _mm256_andnot_ps(signMask,x);
+    __m256 over = _mm256_min_ps(_mm256_mul_ps(_mm256_max_ps(_mm256_sub_ps(a,_mm256_set1_ps(kClipKnee)),_mm256_setzero_ps()),
+                                              _mm256_set1_ps(1.0f / kClipRange)),_mm256_set1_ps(3.0f));
+    __m256 o2 = _mm256_mul_ps(over,over);
+    __m256 shaped = _mm256_div_ps(_mm256_mul_ps(over,_mm256_add_ps(_mm256_set1_ps(27.0f),o2)),
+                                  _mm256_add_ps(_mm256_set1_ps(27.0f),_mm256_mul_ps(_mm256_set1_ps(9.0f),o2)));
+    __m256 y = _mm256_add_ps(_mm256_min_ps(a,_mm256_set1_ps(kClipKnee)),_mm256_mul_ps(_mm256_set1_ps(kClipRange),shaped));
+    return _mm256_or_ps(y,sign);
+}
+
+AUDIODSP_TARGET("avx2")
+void renderAvx2(const float* in, void* out, int n, float gain, float step, OutputFormat format)
+{
+    int i = 0;
+    int16_t* s16 = static_cast<int16_t*>(out);
+    float* f32 = static_cast<float*>(out);
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    __m256 g0 = _mm256_add_ps(_mm256_set1_ps(gain),_mm256_mul_ps(_mm256_set1_ps(step),_mm256_setr_ps(0,1,2,3,4,5,6,7)));
+    __m256 g1 = _mm256_add_ps(g0,_mm256_set1_ps(8 * step));
+    const __m256 inc = _mm256_set1_ps(16 * step);
+    for(; i + 16 <= n; i += 16){
+        __m256 v0 = softClipAvx2(_mm256_mul_ps(_mm256_loadu_ps(in + i),g0));
+        __m256 v1 = softClipAvx2(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8),g1));
+        if(format == OutputFormat::S16){
+            // packs在两个128位通道内分别交错，再用permute恢复顺序
+            __m256i p = _mm256_packs_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(v0,scale)),
+                                           _mm256_cvtps_epi32(_mm256_mul_ps(v1,scale)));
+            p = _mm256_permute4x64_epi64(p,0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(s16 + i),p);
+        }else{
+            _mm256_storeu_ps(f32 + i,v0);
+            _mm256_storeu_ps(f32 + i + 8,v1);
+        }
+        g0 = _mm256_add_ps(g0,inc);
+        g1 = _mm256_add_ps(g1,inc);
+    }
+    if(i < n)
+        renderSse2(in + i,advance(out,i,format),n - i,gain + step * i,step,format);
+}
+
+#endif
+
+using RenderFn = void (*)(const float*, void*, int, float, float, OutputFormat);
+
+struct Impl{
+    RenderFn fn;
+    const char* name;
+};
+
+const std::vector<Impl>& availableImpls()
+{
+    // 静态局部变量的初始化是线程安全的，第一次调用后不再检测
+    static const std::vector<Impl> impls = []{
+        std::vector<Impl> v;
+#ifdef AUDIODSP_X86
+        if(SDL_HasAVX2())
+            v.push_back({&renderAvx2,"avx2"});
+        if(SDL_HasSSE2())
+            v.push_back({&renderSse2,"sse2"});
+#endif
+        v.push_back({&renderScalar,"scalar"});
+        return v;
+    }();
+    return impls;
+}
+
+const Impl& selectImpl()
+{
+    return availableImpls().front();
+}
+
+void renderImpl(const Impl& impl, const float *in, void *out, int frames, int channels,
+                float gainFrom, float gainTo, OutputFormat format)
+{
+    int n = frames * channels;
+    float step = n > 0 ? (gainTo - gainFrom) / n : 0.0f;
+    impl.fn(in,out,n,gainFrom,step,format);
+}
+
+}
+
+void render(const float *in, void *out, int frames, int channels,
+            float gainFrom, float gainTo, OutputFormat format)
+{
+    renderImpl(selectImpl(),in,out,frames,channels,gainFrom,gainTo,format);
+}
+
+void interleave(const float * const *planes, float *out, int frames, int channels)
+{
+    if(channels == 2){
+        // 最常见的立体声单独展开，便于编译器向量化
+        const float* l = planes[0];
+        const float* r = planes[1];
+        for(int i = 0; i < frames; ++i){
+            out[2 * i] = l[i];
+            out[2 * i + 1] = r[i];
+        }
+        return;
+    }
+    for(int c = 0; c < channels; ++c){
+        const float* p = planes[c];
+        float* o = out + c;
+        for(int i = 0; i < frames; ++i)
+            o[static_cast<size_t>(i) * channels] = p[i];
+    }
+}
+
+const char *implementation()
+{
+    return selectImpl().name;
+}
+
+int implementationCount()
+{
+    return static_cast<int>(availableImpls().size());
+}
+
+const char *implementationName(int index)
+{
+    return availableImpls().at(index).name;
+}
+
+void renderWith(int index, const float *in, void *out, int frames, int channels,
+                float gainFrom, float gainTo, OutputFormat format)
+{
+    renderImpl(availableImpls().at(index),in,out,frames,channels,gainFrom,gainTo,format);
+}
+
+}
@@ -0,0 +1,36 @@
+#ifndef AUDIODSP_H
+#define AUDIODSP_H
+
+#include <cstdint>
+
+// 音频回调中的逐块处理：音量渐变、软削波、转换为设备格式，一次遍历完成。
+// 按CPU能力在AVX2、SSE2和标量实现之间选择，选择在第一次调用render时完成。
+namespace AudioDsp {
+
+// 设备采样格式
+enum class OutputFormat{
+    S16,    // 有符号16位
+    F32     // 32位浮点
+};
+
+// in为交错的float采样（frames * channels个），音量从gainFrom线性变化到gainTo，
+// 超过削波阈值的部分平滑压缩到[-1,1]，结果按format写入out
+void render(const float* in, void* out, int frames, int channels,
+            float gainFrom, float gainTo, OutputFormat format);
+
+// 把channels个平面的float采样交错写入out（frames * channels个）
+void interleave(const float* const* planes, float* out, int frames, int channels);
+
+// 当前使用的实现名称，用于日志
+const char* implementation();
+
+// 本机CPU支持的实现个数，按性能从高到低排列，第0个即render使用的实现
+int implementationCount();
+const char* implementationName(int index);
+// 用第index个实现处理，参数同render，供基准测试逐一对比各实现
+void renderWith(int index, const float* in, void* out, int frames, int channels,
+                float gainFrom, float gainTo, OutputFormat format);
+
+}
+
+#endif // AUDIODSP_H
@@ -3,106 +3,257 @@
 #include "audioplayer.h"
 #include <QDebug>
 #include <cstring>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <cmath>
 
+namespace {
 
-void AudioRingBuffer::push(const uint8_t *data, size_t len)
+int64_t steadyNow()
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    cvNotFull_.wait(lock,[&]{
-        return stop_ || buffer_.size() + len <= capacity_;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+
+AudioRingBuffer::AudioRingBuffer(size_t capacity)
+{
+    reset(capacity);
+}
+
+void AudioRingBuffer::reset(size_t capacity)
+{
+    size_t cap = 1;
+    while(cap < capacity)
+        cap <<= 1;
+    data_.reset(new uint8_t[cap]);
+    capacity_ = cap;
+    mask_ = cap - 1;
+    limit_ = std::max<size_t>(capacity,1);
+    head_.store(0,std::memory_order_relaxed);
+    tail_.store(0,std::memory_order_relaxed);
+}
+
+bool AudioRingBuffer::push(const uint8_t *data, size_t len)
+{
+    while(len > 0){
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        // 等待消费者腾出空间，clear/stop时也会被唤醒
+        size_t space = 0;
+        notFull_.wait([&]{
+            size_t used = tail - head_.load(std::memory_order_acquire);
+            space = used < limit_ ? limit_ - used : 0;
+            return stop_.load(std::memory_order_acquire) || space > 0;
+        });
+        if(stop_.load(std::memory_order_acquire))
+            return false;
+
+        // 写入可能跨过缓冲区末尾，分两段拷贝
+        size_t n = std::min(len,space);
+        size_t pos = tail & mask_;
+        size_t first = std::min(n,capacity_ - pos);
+        memcpy(data_.get() + pos,data,first);
+        memcpy(data_.get(),data + first,n - first);
+        tail_.store(tail + n,std::memory_order_release);
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+uint8_t *AudioRingBuffer::beginWrite(size_t len, size_t *granted)
+{
+    len = std::min(len,limit_);
+    *granted = len;
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    notFull_.wait([&]{
+        size_t used = tail - head_.load(std::memory_order_acquire);
+        return stop_.load(std::memory_order_acquire) || used + len <= limit_ || used == 0;
     });
-    if(stop_)
-        return;
+    if(stop_.load(std::memory_order_acquire))
+        return nullptr;
+
+    size_t pos = tail & mask_;
+    reservedScratch_ = len > capacity_ - pos;
+    if(!reservedScratch_)
+        return data_.get() + pos;
+    if(scratch_.size() < len)
+        scratch_.resize(len);
+    return scratch_.data();
+}
 
-    buffer_.insert(buffer_.end(),data,data+len);
-    cvNotEmpty_.notify_one();
+void AudioRingBuffer::commitWrite(size_t len)
+{
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if(reservedScratch_){
+        size_t pos = tail & mask_;
+        size_t first = std::min(len,capacity_ - pos);
+        memcpy(data_.get() + pos,scratch_.data(),first);
+        memcpy(data_.get(),scratch_.data() + first,len - first);
+        reservedScratch_ = false;
+    }
+    tail_.store(tail + len,std::memory_order_release);
 }
 
 size_t AudioRingBuffer::pop(uint8_t *dst, size_t len)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    cvNotEmpty_.wait(lock,[&]{
-        return stop_ || !buffer_.empty();
-    });
-    if(stop_ && buffer_.empty())
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t avail = tail_.load(std::memory_order_acquire) - head;
+    size_t n = std::min(len,avail);
+    if(n == 0){
+        // 上一次tryNotify可能因生产者正持锁检查条件而被放弃，缓冲区读空后不会再有出队来补发，
+        // 因此空读时也要通知，直到生产者真正挂起并被唤醒；无人等待时只有一次原子读
+        notFull_.tryNotify();
         return 0;
-    size_t toCopy = std::min(len,buffer_.size());
-    std::copy_n(buffer_.begin(),toCopy,dst);
-    buffer_.erase(buffer_.begin(),buffer_.begin()+toCopy);
-    cvNotFull_.notify_one();
-    return toCopy;
+    }
+
+    size_t pos = head & mask_;
+    size_t first = std::min(n,capacity_ - pos);
+    memcpy(dst,data_.get() + pos,first);
+    memcpy(dst + first,data_.get(),n - first);
+    // clear可能同时移动了读位置，此时读到的是已作废的数据，不再推进
+    if(!head_.compare_exchange_strong(head,head + n,std::memory_order_acq_rel))
+        return 0;
+    notFull_.tryNotify();
+    return n;
 }
 
 void AudioRingBuffer::stop()
 {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        stop_ = true;
-    }
-    cvNotEmpty_.notify_all();
-    cvNotFull_.notify_all();
+    stop_.store(true,std::memory_order_release);
+    notFull_.notify();
 }
 
 size_t AudioRingBuffer::size() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return buffer_.size();
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+}
+
+size_t AudioRingBuffer::capacity() const
+{
+    return limit_;
 }
 
 void AudioRingBuffer::clear() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    buffer_.clear();
+    // 读位置直接追上写位置
+    size_t head = head_.load(std::memory_order_acquire);
+    while(!head_.compare_exchange_weak(head,tail_.load(std::memory_order_acquire),std::memory_order_acq_rel))
+        ;
+    // 唤醒因缓冲区满而阻塞的写入方
+    notFull_.notify();
+}
+
+size_t AudioRingBuffer::readPosition() const
+{
+    return head_.load(std::memory_order_acquire);
+}
+
+size_t AudioRingBuffer::writePosition() const
+{
+    return tail_.load(std::memory_order_acquire);
 }
 
 bool AudioRingBuffer::isStopped() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return stop_;
+    return stop_.load(std::memory_order_acquire);
 }
 
 
-AudioPlayer::AudioPlayer(int sampleRate, int channels,AVSampleFormat fmt):
-    buffer_(1<<20),
-    outRate_(sampleRate),outChannels_(channels),bytesPerSample_(av_get_bytes_per_sample(fmt))
+AudioPlayer::AudioPlayer(int sampleRate, int channels):
+    buffer_(0), // 设备打开后按协商出的参数和时长分配
+    outRate_(sampleRate),outChannels_(channels),bytesPerSample_(sizeof(float))
 {
 
     SDL_AudioSpec spec{};
-    spec.freq = outRate_;
-    spec.format = AUDIO_S16SYS;
-    spec.channels = outChannels_;
+    spec.freq = sampleRate;
+    spec.format = AUDIO_F32SYS;
+    spec.channels = static_cast<Uint8>(std::clamp(channels,1,8));
     spec.samples = 1024;
     spec.callback = &AudioPlayer::audioCallbackWrapper;
     spec.userdata = this;
-    if(SDL_OpenAudio(&spec,nullptr) < 0)
-        throw std::runtime_error("Failed to open SDL audio");
+    SDL_AudioSpec obtained{};
+    // 按源的格式请求，允许设备改成自己的原生采样率、声道数和格式，避免SDL内部再转换一次
+    deviceId_ = SDL_OpenAudioDevice(nullptr,0,&spec,&obtained,
+                                    SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE
+                                    | SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    if(deviceId_ != 0 && obtained.format != AUDIO_F32SYS && obtained.format != AUDIO_S16SYS){
+        // 回调只输出float和S16，其他原生格式交给SDL转换
+        SDL_CloseAudioDevice(deviceId_);
+        deviceId_ = SDL_OpenAudioDevice(nullptr,0,&spec,&obtained,
+                                        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    }
+    if(deviceId_ == 0)
+        throw std::runtime_error(std::string("Failed to open SDL audio: ") + SDL_GetError());
+
+    // 缓冲区中的数据按设备的采样率和声道数存放
+    outRate_ = obtained.freq;
+    outChannels_ = obtained.channels;
+    deviceFormat_ = obtained.format == AUDIO_S16SYS ? AudioDsp::OutputFormat::S16 : AudioDsp::OutputFormat::F32;
+    deviceSampleBytes_ = deviceFormat_ == AudioDsp::OutputFormat::S16 ? sizeof(int16_t) : sizeof(float);
+    // 回调交出的数据要等设备缓冲中前一块播完才会播出
+    latency_ = double(obtained.samples) / obtained.freq;
+
+    // 设备暂停中，回调尚未运行，可以重新分配缓冲区
+    size_t bufferFrames = static_cast<size_t>(std::ceil(outRate_ * kBufferSeconds));
+    buffer_.reset(bufferFrames * outChannels_ * bytesPerSample_);
+
+    // 回调中不分配内存，float缓冲按设备回调帧数预先分配
+    mixFrames_ = obtained.samples > 0 ? obtained.samples : spec.samples;
+    mixBuf_.reset(new float[static_cast<size_t>(mixFrames_) * outChannels_]);
+    currentGain_ = volume_.load(std::memory_order_relaxed);
+    qDebug() << "audio device:" << outRate_ << "Hz" << outChannels_ << "ch"
+             << (deviceFormat_ == AudioDsp::OutputFormat::S16 ? "s16" : "f32")
+             << "latency:" << latency_ * 1000 << "ms buffer:" << kBufferSeconds * 1000 << "ms"
+             << "dsp:" << AudioDsp::implementation();
 }
 
 AudioPlayer::~AudioPlayer()
 {
     buffer_.stop();
-    SDL_CloseAudio();
+    SDL_CloseAudioDevice(deviceId_);
 }
 
-void AudioPlayer::enqueue(const uint8_t *data, size_t len)
+bool AudioPlayer::enqueue(const uint8_t *data, size_t len)
 {
-    buffer_.push(data,len);
+    return buffer_.push(data,len);
 }
 
 
 
+uint8_t *AudioPlayer::beginWrite(size_t len, size_t *granted)
+{
+    return buffer_.beginWrite(len,granted);
+}
+
+void AudioPlayer::commitWrite(size_t len)
+{
+    buffer_.commitWrite(len);
+}
+
 void AudioPlayer::play()
 {
-    SDL_PauseAudio(0);
+    SDL_PauseAudioDevice(deviceId_,0);
 }
 
 void AudioPlayer::pause(bool paused)
 {
-    SDL_PauseAudio(paused?1:0);
+    SDL_PauseAudioDevice(deviceId_,paused?1:0);
+    if(!paused)
+        return;
+    // 暂停后回调不再运行，把时钟冻结在当前位置；恢复后由下一次回调重新计时
+    SDL_LockAudioDevice(deviceId_);
+    double now = clockAt(steadyNow());
+    publishClock(now,clockEnd_.load(std::memory_order_relaxed),0.f,steadyNow());
+    SDL_UnlockAudioDevice(deviceId_);
 }
 
 void AudioPlayer::stop()
 {
     // 先暂停音频设备
-    SDL_PauseAudio(1);
+    SDL_PauseAudioDevice(deviceId_,1);
 
     // 停止缓冲区
     buffer_.stop();
@@ -110,7 +261,10 @@ void AudioPlayer::stop()
     // 清空缓冲区
     buffer_.clear();
 
+    SDL_LockAudioDevice(deviceId_);
     audioClock_ = 0.0;
+    publishClock(0.0,0.0,0.f,steadyNow());
+    SDL_UnlockAudioDevice(deviceId_);
 }
 
 void AudioPlayer::clearBuf()
@@ -122,25 +276,69 @@ void AudioPlayer::clearBuf()
 
 void AudioPlayer::setAudioClock(double v)
 {
+    // 持有设备锁时回调不会运行，保证快照只有一个写入方
+    SDL_LockAudioDevice(deviceId_);
     audioClock_ = v;
+    // 新数据还没交给设备，时钟停在v，直到下一次回调
+    publishClock(v,v,0.f,steadyNow());
+    SDL_UnlockAudioDevice(deviceId_);
 }
 
 double AudioPlayer::getAudioClock() const
 {
-    return audioClock_;
+    return clockAt(steadyNow());
+}
+
+void AudioPlayer::publishClock(double base, double end, float rate, int64_t stamp)
+{
+    uint32_t seq = clockSeq_.load(std::memory_order_relaxed);
+    clockSeq_.store(seq + 1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    clockBase_.store(base,std::memory_order_relaxed);
+    clockEnd_.store(end,std::memory_order_relaxed);
+    clockStamp_.store(stamp,std::memory_order_relaxed);
+    clockRate_.store(rate,std::memory_order_relaxed);
+    clockSeq_.store(seq + 2,std::memory_order_release);
+}
+
+double AudioPlayer::clockAt(int64_t now) const
+{
+    double base, end;
+    int64_t stamp;
+    float rate;
+    while(true){
+        uint32_t seq = clockSeq_.load(std::memory_order_acquire);
+        base = clockBase_.load(std::memory_order_relaxed);
+        end = clockEnd_.load(std::memory_order_relaxed);
+        stamp = clockStamp_.load(std::memory_order_relaxed);
+        rate = clockRate_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // 写入方只在回调或设备锁内，读到奇数或前后不一致时重读即可
+        if(!(seq & 1) && clockSeq_.load(std::memory_order_relaxed) == seq)
+            break;
+    }
+    double elapsed = std::max<int64_t>(now - stamp,0) * 1e-9;
+    return std::min(base + elapsed * rate,end);
 }
 
 void AudioPlayer::setSpeed_(float speed)
 {
-    speed_ = speed;
+    speedMarkPos_.store(buffer_.writePosition(),std::memory_order_relaxed);
+    pendingSpeed_.store(speed,std::memory_order_relaxed);
+    speedPending_.store(true,std::memory_order_release);
+}
+
+float AudioPlayer::playbackSpeed() const
+{
+    return playSpeed_.load(std::memory_order_relaxed);
 }
 
 void AudioPlayer::setVolume(float volume) {
-    volume_ = std::clamp(volume, 0.0f, 1.0f);
+    volume_.store(std::clamp(volume, 0.0f, 1.0f),std::memory_order_relaxed);
 }
 
 float AudioPlayer::getVolume() const {
-    return volume_;
+    return volume_.load(std::memory_order_relaxed);
 }
 
 
@@ -164,78 +362,64 @@ void AudioPlayer::audioCallbackWrapper(void *userdata, uint8_t *stream, int len)
 // }
 
 void AudioPlayer::audioCallback(uint8_t *stream, int len) {
-    SDL_memset(stream, 0, len); // 清空输出缓冲区
-
-    if (buffer_.size() == 0) {
-        return;
+    // 运行在音频设备线程：不加锁、不阻塞、不分配内存
+    // 时间戳取在回调开始时，与设备开始消耗上一块数据的时刻最接近
+    const int64_t stamp = steadyNow();
+    // 缓冲区中为交错float；音量、削波和转换为设备格式在AudioDsp::render中一次完成
+    const int frameBytes = outChannels_ * bytesPerSample_;
+    const int deviceFrameBytes = outChannels_ * deviceSampleBytes_;
+    const int frames = len / deviceFrameBytes;
+    const float target = volume_.load(std::memory_order_relaxed);
+    const float gainStep = frames > 0 ? (target - currentGain_) / frames : 0.0f;
+
+    size_t copied = 0;
+    int done = 0;
+    // 回调请求的帧数一般等于打开设备时的大小，超出时分块处理
+    while(done < frames){
+        int chunk = std::min(frames - done,mixFrames_);
+        size_t want = static_cast<size_t>(chunk) * frameBytes;
+        size_t n = buffer_.pop(reinterpret_cast<uint8_t*>(mixBuf_.get()),want);
+        copied += n;
+        if(n < want){
+            // 数据不足的部分补零，仍经过render以保持音量渐变连续
+            std::memset(reinterpret_cast<uint8_t*>(mixBuf_.get()) + n,0,want - n);
+        }
+        float from = currentGain_ + gainStep * done;
+        AudioDsp::render(mixBuf_.get(),stream + static_cast<size_t>(done) * deviceFrameBytes,chunk,outChannels_,
+                         from,from + gainStep * chunk,deviceFormat_);
+        done += chunk;
+        if(n < want)
+            break;
     }
-
-    // 使用临时缓冲区
-    std::vector<uint8_t> temp(len);
-    size_t copied = buffer_.pop(temp.data(), len);
-
-    if (copied < static_cast<size_t>(len)) {
-        SDL_memset(temp.data() + copied, 0, len - copied);
+    currentGain_ = target;
+    // 提前结束时剩余部分静音
+    if(done < frames)
+        SDL_memset(stream + static_cast<size_t>(done) * deviceFrameBytes,0,static_cast<size_t>(frames - done) * deviceFrameBytes);
+
+    if (copied < static_cast<size_t>(frames) * frameBytes)
+        ++underruns_;
+
+    // 播放到倍速切换点后按新倍速计时，切换点落在本次回调中间的误差不超过一个回调
+    if(speedPending_.load(std::memory_order_acquire)){
+        size_t mark = speedMarkPos_.load(std::memory_order_relaxed);
+        if(static_cast<std::ptrdiff_t>(buffer_.readPosition() - mark) >= 0){
+            playSpeed_.store(pendingSpeed_.load(std::memory_order_relaxed),std::memory_order_relaxed);
+            speedPending_.store(false,std::memory_order_relaxed);
+        }
     }
 
-    // 应用音量控制 - 核心代码
-    int sdlVolume = static_cast<int>(volume_ * SDL_MIX_MAXVOLUME);
-    SDL_MixAudio(stream, temp.data(), len, sdlVolume);
-
-    // 更新音频时钟
-    audioClock_ = audioClock_ + double(copied) / (outChannels_ * bytesPerSample_ * outRate_);
+    // 更新音频时钟，变速后每秒输出对应speed秒的媒体时间
+    const float speed = playSpeed_.load(std::memory_order_relaxed);
+    double end = audioClock_ + double(copied) * speed / (outChannels_ * bytesPerSample_ * outRate_);
+    audioClock_ = end;
+    // 此刻设备开始播出上一次回调交出的那一块，本次交出的排在其后；
+    // 用实际交出的时长而不是固定的latency_，缓冲区读空时时钟停在数据末尾而不会回退
+    double delivered = double(copied / frameBytes) / outRate_;
+    publishClock(end - (delivered + prevDelivered_) * speed,end,speed,stamp);
+    prevDelivered_ = delivered;
 }
 
-
-// void AudioPlayer::audioCallback(uint8_t *stream, int len) {
-//     SDL_memset(stream, 0, len);
-
-//     if (buffer_.size() == 0) {
-//         return;
-//     }
-
-//     // 从环形缓冲取数据
-//     std::vector<uint8_t> temp(len);
-//     size_t copied = buffer_.pop(temp.data(), len);
-
-//     // 输入样本数（每声道）
-//     int inputSamplesPerChannel = (copied / sizeof(short)) / outChannels_;
-
-//     // 估算输出最大样本数（考虑变速）
-//     int maxOutputSamplesPerChannel = static_cast<int>(inputSamplesPerChannel / speed_) + 1024;
-
-//     std::vector<short> outputBuffer(maxOutputSamplesPerChannel * outChannels_);
-
-//     // Sonic 处理
-//     int samplesGeneratedPerChannel = sp_.process(
-//         reinterpret_cast<short*>(temp.data()),
-//         inputSamplesPerChannel,
-//         outputBuffer.data(),
-//         maxOutputSamplesPerChannel
-//         );
-
-//     int bytesGenerated = samplesGeneratedPerChannel * outChannels_ * sizeof(short);
-
-//     int sdlVolume = static_cast<int>(volume_ * SDL_MIX_MAXVOLUME);
-
-//     if (bytesGenerated > 0) {
-//         int bytesToCopy = std::min(len, bytesGenerated);
-//         SDL_MixAudio(stream,
-//                      reinterpret_cast<uint8_t*>(outputBuffer.data()),
-//                      bytesToCopy,
-//                      sdlVolume);
-
-//         if (bytesToCopy < len) {
-//             SDL_memset(stream + bytesToCopy, 0, len - bytesToCopy);
-//         }
-//     } else {
-//         SDL_MixAudio(stream, temp.data(),
-//                      std::min(len, static_cast<int>(copied)),
-//                      sdlVolume);
-//     }
-
-//     // 更新时钟：基于原始输入数据量
-//     double secondsConsumed = static_cast<double>(copied) /
-//                              (outChannels_ * bytesPerSample_ * outRate_);
-//     audioClock_ = audioClock_ + secondsConsumed;
-// }
+uint64_t AudioPlayer::underruns() const
+{
+    return underruns_;
+}
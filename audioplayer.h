@@ -2,11 +2,12 @@
 #define AUDIOPLAYER_H
 
 
-#include <deque>
-#include <mutex>
+#include <memory>
+#include <vector>
 #include <atomic>
-#include <condition_variable>
 #include <cstdint>
+#include "waitnotifier.h"
+#include "audiodsp.h"
 
 
 
@@ -17,45 +18,100 @@ extern "C"{
 #include <libavutil/avutil.h>
 }
 
+// 单生产者/单消费者的PCM字节环形缓冲
+// 生产者为音频解码线程，消费者为SDL音频回调。
+// 读写位置为单调递增的原子计数，存储大小为2的幂，读写最多分两段memcpy。
+// 可写入的数据量受limit限制（不必是2的幂），用于按时长而不是按存储大小控制缓冲深度。
+// pop不加锁、不阻塞、不分配内存，可以在音频回调中调用；push在空间不足时挂起等待。
 class AudioRingBuffer{
 public:
-    AudioRingBuffer(size_t capacity = 1 << 20) // 默认1MB
-        : capacity_(capacity),stop_(false){}
-    void push(const uint8_t* data, size_t len);
+    // 存储大小为capacity向上取整的2的幂，limit为capacity
+    explicit AudioRingBuffer(size_t capacity = 1 << 20); // 默认1MB
+    // 重新分配为capacity字节并清空，只能在没有读写方时调用
+    void reset(size_t capacity);
+    AudioRingBuffer(const AudioRingBuffer&) = delete;
+    AudioRingBuffer& operator=(const AudioRingBuffer&) = delete;
+
+    // 写入len字节，空间不足时等待消费者读出，返回false表示已停止
+    bool push(const uint8_t* data, size_t len);
+    // 预留最多len字节的写入空间，空间不足时等待，返回可直接写入的连续内存，已停止时返回nullptr
+    // 预留区域跨过缓冲区末尾时返回内部的临时缓冲，提交时再分两段拷入
+    // len超过limit时等缓冲区读空后只预留limit字节，实际预留的长度写入granted，调用方需分段写入
+    uint8_t* beginWrite(size_t len, size_t* granted);
+    // 提交预留区域开头的len字节，len不能超过预留的长度
+    void commitWrite(size_t len);
+    // 读出最多len字节，返回实际字节数
     size_t pop(uint8_t* dst,size_t len);
     void stop();
     size_t size()const;
+    // 可写入的数据量上限（limit）
+    size_t capacity()const;
+    // 单调递增的读/写位置（字节）
+    size_t readPosition()const;
+    size_t writePosition()const;
+    // 丢弃已写入的数据，可在任意线程调用；与之并发写入的数据可能被保留
     void clear();
     bool isStopped() const;
 
 private:
-    size_t capacity_;
-    std::deque<uint8_t> buffer_;
-    mutable std::mutex mutex_;
-    std::condition_variable cvNotEmpty_;
-    std::condition_variable cvNotFull_;
-    bool stop_ = false;
+    static constexpr size_t kCacheLine = 64;
 
+    std::unique_ptr<uint8_t[]> data_;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    size_t limit_ = 0;
 
+    // 写位置，由生产者推进
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+    // 读位置，由消费者推进，clear时也会被其他线程修改
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
 
+    // 预留区域跨过末尾时使用的临时缓冲，生产者独占，只增不减
+    std::vector<uint8_t> scratch_;
+    bool reservedScratch_ = false;
+
+    alignas(kCacheLine) std::atomic<bool> stop_{false};
+    // 消费者读出数据后通知等待空间的生产者
+    WaitNotifier notFull_;
 };
 
 
 class AudioPlayer
 {
 public:
-    AudioPlayer(int sampleRate = 44100,int channels = 2,AVSampleFormat fmt = AV_SAMPLE_FMT_S16);
+    // 缓冲区按时长分配，过深会拖慢跳转、停止的响应
+    static constexpr double kBufferSeconds = 0.2;
+
+    // 以sampleRate/channels为期望值打开默认设备，实际采用设备协商后的原生参数，
+    // 写入缓冲区的数据须为该参数下的交错float
+    AudioPlayer(int sampleRate = 44100,int channels = 2);
     ~AudioPlayer();
-    void enqueue(const uint8_t* data, size_t len);
+    // 设备实际的采样率与声道数
+    int sampleRate() const { return outRate_; }
+    int channels() const { return outChannels_; }
+    // 设备缓冲带来的输出时延（秒），即回调交出的数据在设备队列中等待的时间
+    double latency() const { return latency_; }
+    // 写入len字节，空间不足时分段等待，返回false表示已停止
+    bool enqueue(const uint8_t* data, size_t len);
+    // 直接写入缓冲区，见AudioRingBuffer::beginWrite/commitWrite
+    uint8_t* beginWrite(size_t len, size_t* granted);
+    void commitWrite(size_t len);
     void play();
     void pause(bool paused);
     void stop();
     void clearBuf();
 
+    // 设置已写入数据末尾对应的媒体时间，跳转清空缓冲区后调用
     void setAudioClock(double v);
+    // 正在从设备播出的媒体时间：以最近一次回调的时间戳为基准按倍速插值，
+    // 已扣除设备缓冲的时延，且不超过已交给设备的数据末尾
     double getAudioClock() const;
 
+    // 之后写入缓冲区的数据按speed倍速播放（由音频解码线程在变速输出前调用），
+    // 回调播放到该位置时按新倍速推进音频时钟
     void setSpeed_(float speed);
+    // 正在播放的数据的倍速
+    float playbackSpeed() const;
 
     void setEof(bool b);
 
@@ -64,15 +120,44 @@ public:
     void setVolume(float volume);
 
     float getVolume() const;
+
+    // 回调中缓冲区数据不足、用静音补齐的次数
+    uint64_t underruns() const;
 private:
     AudioRingBuffer buffer_;
-    // 变速处理器
+    // SDL_AudioDeviceID，头文件中不引入SDL
+    uint32_t deviceId_ = 0;
+    AudioDsp::OutputFormat deviceFormat_ = AudioDsp::OutputFormat::F32;
+    int deviceSampleBytes_ = sizeof(float);
     int outRate_;
     int outChannels_;
     int bytesPerSample_;
-    float volume_ = 1.f;
-    float speed_ = 1.f;
-    std::atomic<double> audioClock_;
+    // 目标音量由界面线程写入；回调内记录上次实际使用的音量，在一个回调内渐变过去避免爆音
+    std::atomic<float> volume_{1.f};
+    float currentGain_ = 1.f;
+    // 倍速切换点：写入位置与新倍速，回调读到该位置后生效
+    std::atomic<size_t> speedMarkPos_{0};
+    std::atomic<float> pendingSpeed_{1.f};
+    std::atomic<bool> speedPending_{false};
+    std::atomic<float> playSpeed_{1.f};
+    // 已交给设备的数据末尾对应的媒体时间，回调中推进
+    std::atomic<double> audioClock_{0.0};
+    double latency_ = 0.0;
+    // 上一次回调交出的数据时长（秒），只在回调中使用
+    double prevDelivered_ = 0.0;
+    // 时钟快照（seqlock）：回调或持有设备锁的线程写入，任意线程无锁读取
+    // stamp时刻正在播出base，之后每秒推进rate，不超过end
+    std::atomic<uint32_t> clockSeq_{0};
+    std::atomic<double> clockBase_{0.0};
+    std::atomic<double> clockEnd_{0.0};
+    std::atomic<int64_t> clockStamp_{0};
+    std::atomic<float> clockRate_{0.f};
+    void publishClock(double base, double end, float rate, int64_t stamp);
+    double clockAt(int64_t now) const;
+    // 回调使用的float缓冲（交错），打开设备时按回调帧数预先分配
+    std::unique_ptr<float[]> mixBuf_;
+    int mixFrames_ = 0;
+    std::atomic<uint64_t> underruns_{0};
     static void audioCallbackWrapper(void* userdata, uint8_t* stream, int len);
     void audioCallback(uint8_t* stream, int len);
 };
@@ -0,0 +1,98 @@
+// 音频回调处理的微基准
+// 对比旧回调（清零输出、出队拷贝S16、SDL_MixAudioFormat调音量）与
+// 新回调（出队拷贝float、AudioDsp::render一次完成渐变/削波/转换）在各实现下的耗时，
+// 并检查各实现的输出与标量实现只差舍入误差。
+// 用法：audiodspbench [每种方式的迭代次数]
+#include <SDL2/SDL.h>
+#undef main
+#include "audiodsp.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// 与AudioPlayer默认打开设备时的回调大小一致：1024帧立体声
+constexpr int kFrames = 1024;
+constexpr int kChannels = 2;
+constexpr int kSamples = kFrames * kChannels;
+
+template<typename Fn>
+double nanosecondsPerBlock(int iterations, Fn fn)
+{
+    // 预热，排除首次调用的实现选择和缓存冷启动
+    for(int i = 0; i < iterations / 10 + 1; ++i)
+        fn();
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; ++i)
+        fn();
+    return std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = argc > 1 ? std::max(1,std::atoi(argv[1])) : 200000;
+
+    // 略超过满幅的正弦，覆盖削波区间
+    std::vector<float> ringF32(kSamples);
+    std::vector<int16_t> ringS16(kSamples);
+    for(int i = 0; i < kSamples; ++i){
+        ringF32[i] = 1.2f * std::sin(i * 0.01f);
+        ringS16[i] = static_cast<int16_t>(std::clamp(ringF32[i],-1.0f,1.0f) * 32767);
+    }
+    std::vector<float> mixF32(kSamples);
+    std::vector<int16_t> mixS16(kSamples);
+    std::vector<uint8_t> stream(kSamples * sizeof(float));
+
+    int volume = SDL_MIX_MAXVOLUME * 3 / 4;
+    double oldNs = nanosecondsPerBlock(iterations,[&]{
+        SDL_memset(stream.data(),0,kSamples * sizeof(int16_t));
+        std::memcpy(mixS16.data(),ringS16.data(),kSamples * sizeof(int16_t));
+        SDL_MixAudioFormat(stream.data(),reinterpret_cast<const Uint8*>(mixS16.data()),AUDIO_S16SYS,
+                           kSamples * sizeof(int16_t),volume);
+    });
+    std::printf("%-8s %-4s %8.0f ns/block\n","SDL_Mix","s16",oldNs);
+
+    // 标量实现总是排在最后，作为对比基准
+    int scalar = AudioDsp::implementationCount() - 1;
+    std::vector<int16_t> refS16(kSamples), outS16(kSamples);
+    std::vector<float> refF32(kSamples), outF32(kSamples);
+    AudioDsp::renderWith(scalar,ringF32.data(),refS16.data(),kFrames,kChannels,0.3f,0.9f,AudioDsp::OutputFormat::S16);
+    AudioDsp::renderWith(scalar,ringF32.data(),refF32.data(),kFrames,kChannels,0.3f,0.9f,AudioDsp::OutputFormat::F32);
+
+    int failures = 0;
+    for(int impl = 0; impl < AudioDsp::implementationCount(); ++impl){
+        const AudioDsp::OutputFormat formats[] = {AudioDsp::OutputFormat::S16,AudioDsp::OutputFormat::F32};
+        for(AudioDsp::OutputFormat format : formats){
+            double ns = nanosecondsPerBlock(iterations,[&]{
+                std::memcpy(mixF32.data(),ringF32.data(),kSamples * sizeof(float));
+                AudioDsp::renderWith(impl,mixF32.data(),stream.data(),kFrames,kChannels,0.3f,0.9f,format);
+            });
+            bool s16 = format == AudioDsp::OutputFormat::S16;
+            std::printf("%-8s %-4s %8.0f ns/block  %.2fx\n",AudioDsp::implementationName(impl),
+                        s16 ? "s16" : "f32",ns,oldNs / ns);
+        }
+
+        AudioDsp::renderWith(impl,ringF32.data(),outS16.data(),kFrames,kChannels,0.3f,0.9f,AudioDsp::OutputFormat::S16);
+        AudioDsp::renderWith(impl,ringF32.data(),outF32.data(),kFrames,kChannels,0.3f,0.9f,AudioDsp::OutputFormat::F32);
+        int maxS16 = 0;
+        float maxF32 = 0.0f;
+        for(int i = 0; i < kSamples; ++i){
+            maxS16 = std::max(maxS16,std::abs(outS16[i] - refS16[i]));
+            maxF32 = std::max(maxF32,std::fabs(outF32[i] - refF32[i]));
+        }
+        // 向量实现按通道累加音量、用倒数乘代替除法，与标量实现只有舍入差异
+        bool ok = maxS16 <= 1 && maxF32 < 1e-4f;
+        std::printf("%-8s max diff vs scalar: s16 %d, f32 %g %s\n",AudioDsp::implementationName(impl),
+                    maxS16,maxF32,ok ? "" : "MISMATCH");
+        if(!ok)
+            ++failures;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -1,11 +1,32 @@
 #include "ctrlbar.h"
 #include "ui_ctrlbar.h"
+#include "thumbnailprovider.h"
+#include <QLabel>
+#include <QPainter>
 #include <QMouseEvent>
 #include <QDebug>
 #include <sstream>
 #include <iomanip>
 #include <QAbstractItemView>
 
+namespace {
+
+std::string formatTime(double seconds)
+{
+    int totalSeconds = static_cast<int>(seconds + 0.5);
+    int h = totalSeconds / 3600;
+    int m = (totalSeconds % 3600) / 60;
+    int s = totalSeconds % 60;
+
+    std::ostringstream oss;
+    oss << std::setfill('0') << std::setw(2) << h << ":"
+        << std::setfill('0') << std::setw(2) << m << ":"
+        << std::setfill('0') << std::setw(2) << s;
+    return oss.str();
+}
+
+}
+
 CtrlBar::CtrlBar(QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::CtrlBar)
@@ -62,6 +83,14 @@ CtrlBar::CtrlBar(QWidget *parent)
         emit seekRequested(pos); // 发信号告诉 Player 去 seek
     });
 
+    // 进度条悬停预览
+    connect(this->ui->progress_slid,&VideoSlider::hoverMoved,this,[this](double pos,int x){
+        showPreview(pos,x);
+    });
+    connect(this->ui->progress_slid,&VideoSlider::hoverLeft,this,[this]{
+        hidePreview();
+    });
+
     connect(this->ui->vol_slid,&QSlider::sliderReleased,this,[this]{
         float pos = ui->vol_slid->value() / static_cast<float>(ui->vol_slid->maximum());
         emit volumeChanged(pos);
@@ -73,6 +102,12 @@ CtrlBar::CtrlBar(QWidget *parent)
         emit aspectRatioChanged(mode);
     });
 
+    // 播放倍速改变
+    connect(this->ui->speed_cb,QOverload<int>::of(&OverlayComboBox::currentIndexChanged),this, [this]{
+        double speed = this->ui->speed_cb->currentData().toDouble();
+        emit speedChanged(speed);
+    });
+
     // 上一个被点击
     connect(this->ui->pre_btn,&QPushButton::clicked,this,[this](){
         emit preClicked();
@@ -102,9 +137,61 @@ CtrlBar::CtrlBar(QWidget *parent)
 
 CtrlBar::~CtrlBar()
 {
+    delete preview_;
     delete ui;
 }
 
+void CtrlBar::setThumbnailProvider(ThumbnailProvider *provider)
+{
+    thumbnails_ = provider;
+    if(!provider)
+        return;
+    // 缩略图生成完成时刷新正在显示的预览
+    connect(provider,&ThumbnailProvider::thumbnailReady,this,[this](int index){
+        if(hoverPos_ >= 0.0 && thumbnails_ && thumbnails_->indexAt(hoverPos_) == index)
+            showPreview(hoverPos_,hoverX_);
+    },Qt::QueuedConnection);
+}
+
+void CtrlBar::showPreview(double pos, int x)
+{
+    hoverPos_ = pos;
+    hoverX_ = x;
+    if(!thumbnails_ || thumbnails_->duration() <= 0.0)
+        return;
+
+    QImage img = thumbnails_->thumbnailAt(pos);
+    if(img.isNull())
+        return;
+
+    // 在缩略图底部绘制对应的时间
+    QString text = QString::fromStdString(formatTime(pos * thumbnails_->duration()));
+    QPainter painter(&img);
+    painter.fillRect(0,img.height() - 18,img.width(),18,QColor(0,0,0,160));
+    painter.setPen(Qt::white);
+    painter.drawText(QRect(0,img.height() - 18,img.width(),18),Qt::AlignCenter,text);
+    painter.end();
+
+    if(!preview_){
+        preview_ = new QLabel(nullptr,Qt::ToolTip | Qt::FramelessWindowHint);
+        preview_->setAttribute(Qt::WA_TransparentForMouseEvents);
+        preview_->setAttribute(Qt::WA_ShowWithoutActivating);
+    }
+    preview_->setPixmap(QPixmap::fromImage(img));
+    preview_->setFixedSize(img.width(),img.height());
+    // 显示在进度条上方，水平居中于鼠标位置
+    QPoint anchor = ui->progress_slid->mapToGlobal(QPoint(x,0));
+    preview_->move(anchor.x() - img.width()/2,anchor.y() - img.height() - 6);
+    preview_->show();
+}
+
+void CtrlBar::hidePreview()
+{
+    hoverPos_ = -1.0;
+    if(preview_)
+        preview_->hide();
+}
+
 void CtrlBar::updateProgress(double currentTime, double totalTime)
 {
     if(totalTime <= 0.0){
@@ -113,18 +200,6 @@ void CtrlBar::updateProgress(double currentTime, double totalTime)
         ui->progress_slid->setValue(0);
         return;
     }
-    static auto formatTime = [](double seconds){
-        int totalSeconds = static_cast<int>(seconds + 0.5);
-        int h = totalSeconds / 3600;
-        int m = (totalSeconds % 3600) / 60;
-        int s = totalSeconds % 60;
-
-        std::ostringstream oss;
-        oss << std::setfill('0') << std::setw(2) << h << ":"
-            << std::setfill('0') << std::setw(2) << m << ":"
-            << std::setfill('0') << std::setw(2) << s;
-        return oss.str();
-    };
     if(!isDragging_){
         ui->now_time_lb->setText(QString::fromStdString(formatTime(currentTime)));
         ui->total_time_lb->setText(QString::fromStdString(formatTime(totalTime)));
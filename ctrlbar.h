@@ -3,6 +3,9 @@
 
 #include <QWidget>
 
+class QLabel;
+class ThumbnailProvider;
+
 namespace Ui {
 class CtrlBar;
 }
@@ -15,6 +18,9 @@ public:
     explicit CtrlBar(QWidget *parent = nullptr);
     ~CtrlBar();
 
+    // 设置进度条悬停预览的缩略图来源，为nullptr时不显示预览
+    void setThumbnailProvider(ThumbnailProvider* provider);
+
 signals:
     void openFileClicked();
     void stopClicked();
@@ -30,15 +36,27 @@ signals:
     void volumeChanged(float vol);
     // 修改视频显示比例信号
     void aspectRatioChanged(int value);
+    // 播放倍速改变信号
+    void speedChanged(double speed);
     // 改变播放模式
     void changeModel(int model);
 public slots:
     // 更新进度条槽函数
     void updateProgress(double currentTime, double totalTime);
 private:
+    // 显示/刷新悬停预览
+    void showPreview(double pos, int x);
+    void hidePreview();
+
     Ui::CtrlBar *ui;
 
     bool isDragging_ = false;
+
+    ThumbnailProvider* thumbnails_ = nullptr;
+    QLabel* preview_ = nullptr;
+    // 当前悬停的进度和坐标，未悬停时为负
+    double hoverPos_ = -1.0;
+    int hoverX_ = 0;
 };
 
 #endif // CTRLBAR_H
@@ -0,0 +1,102 @@
+#include "framequeue.h"
+#include <algorithm>
+
+extern "C"{
+#include <libavutil/frame.h>
+}
+
+FrameQueue::FrameQueue(int depth)
+    :frames_(kMaxDepth)
+    ,depth_(std::clamp(depth,1,kMaxDepth))
+{
+    for(Frame& f : frames_)
+        f.frame = av_frame_alloc();
+}
+
+FrameQueue::~FrameQueue()
+{
+    for(Frame& f : frames_)
+        av_frame_free(&f.frame);
+}
+
+void FrameQueue::setDepth(int depth)
+{
+    clear();
+    std::lock_guard<std::mutex> lock(mtx_);
+    depth_ = std::clamp(depth,1,kMaxDepth);
+}
+
+int FrameQueue::depth() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return depth_;
+}
+
+FrameQueue::Frame *FrameQueue::peekWritable()
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock,[this]{ return abort_ || size_ < depth_; });
+    if(abort_)
+        return nullptr;
+    return &frames_[windex_];
+}
+
+void FrameQueue::push()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        windex_ = (windex_ + 1) % depth_;
+        ++size_;
+    }
+    cv_.notify_all();
+}
+
+FrameQueue::Frame *FrameQueue::peekReadable(bool blocking)
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    if(blocking)
+        cv_.wait(lock,[this]{ return abort_ || size_ > 0; });
+    if(abort_ || size_ == 0)
+        return nullptr;
+    return &frames_[rindex_];
+}
+
+void FrameQueue::next()
+{
+    // 读写位置不会指向同一个已占用的槽，释放帧数据无需持锁
+    av_frame_unref(frames_[rindex_].frame);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        rindex_ = (rindex_ + 1) % depth_;
+        --size_;
+    }
+    cv_.notify_all();
+}
+
+int FrameQueue::size() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return size_;
+}
+
+void FrameQueue::setAbort(bool abort)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        abort_ = abort;
+    }
+    cv_.notify_all();
+}
+
+void FrameQueue::clear()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    for(Frame& f : frames_){
+        av_frame_unref(f.frame);
+        f.eof = false;
+        f.serial = -1;
+    }
+    rindex_ = 0;
+    windex_ = 0;
+    size_ = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+struct AVFrame;
+
+// 已解码视频帧的有界队列（参考ffplay的FrameQueue）
+// 解码线程提前解码若干帧放入队列，显示线程按时间取出，
+// 单帧解码耗时的波动被队列中的余量吸收，不再直接导致显示延迟。
+// 只支持一个写线程和一个读线程。
+class FrameQueue
+{
+public:
+    struct Frame{
+        AVFrame* frame = nullptr;
+        double pts = 0.0;       // 显示时间（秒）
+        double duration = 0.0;  // 帧时长（秒），未知时为0
+        int serial = -1;        // 所属的包序列号
+        bool eof = false;       // 文件结束标记，不含图像
+    };
+
+    // 队列深度上限
+    static constexpr int kMaxDepth = 16;
+
+    explicit FrameQueue(int depth = 4);
+    ~FrameQueue();
+
+    // 设置队列深度，只能在读写线程都未运行时调用
+    void setDepth(int depth);
+    int depth() const;
+
+    // 获取可写入的空位，队列满时阻塞，中止时返回nullptr
+    Frame* peekWritable();
+    // 提交peekWritable取得的空位
+    void push();
+
+    // 获取队首帧，队列为空时blocking为true则阻塞，中止或非阻塞且为空时返回nullptr
+    Frame* peekReadable(bool blocking = true);
+    // 释放队首帧
+    void next();
+
+    // 当前已解码未显示的帧数
+    int size() const;
+
+    // 中止/恢复，中止时唤醒所有等待的线程
+    void setAbort(bool abort);
+    // 释放所有帧，需在读写线程停止后调用
+    void clear();
+
+private:
+    std::vector<Frame> frames_;
+    int depth_;
+    int rindex_ = 0;
+    int windex_ = 0;
+    int size_ = 0;
+    bool abort_ = false;
+
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+};
+
+#endif // FRAMEQUEUE_H
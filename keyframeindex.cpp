@@ -0,0 +1,266 @@
+#include "keyframeindex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDebug>
+
+extern "C"{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+namespace {
+
+const char kMagic[4] = {'K','F','I','1'};
+
+// 无符号变长整数编码，每字节7位
+void putVarint(QByteArray& out, uint64_t v)
+{
+    while(v >= 0x80){
+        out.append(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.append(static_cast<char>(v));
+}
+
+bool getVarint(const char*& p, const char* end, uint64_t& v)
+{
+    v = 0;
+    for(int shift = 0; shift < 64 && p < end; shift += 7){
+        uint8_t b = static_cast<uint8_t>(*p++);
+        v |= uint64_t(b & 0x7f) << shift;
+        if(!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// 有符号数先做zigzag变换，使小的负增量也只占一个字节
+uint64_t zigzag(int64_t v)
+{
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v)
+{
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+}
+
+void KeyframeIndex::reset(const std::string &url, int streamIndex)
+{
+    QFileInfo info(QString::fromStdString(url));
+    std::lock_guard<std::mutex> lock(mtx_);
+    url_ = url;
+    streamIndex_ = streamIndex;
+    fileSize_ = info.size();
+    mtime_ = info.lastModified().toMSecsSinceEpoch();
+    entries_.clear();
+    complete_ = false;
+}
+
+bool KeyframeIndex::load()
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        path = cachePath();
+    }
+    QFile file(QString::fromStdString(path));
+    if(path.empty() || !file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray data = file.readAll();
+    const char* p = data.constData();
+    const char* end = p + data.size();
+
+    if(end - p < 4 || memcmp(p,kMagic,4) != 0)
+        return false;
+    p += 4;
+
+    uint64_t fileSize = 0, mtime = 0, stream = 0, count = 0;
+    if(!getVarint(p,end,fileSize) || !getVarint(p,end,mtime)
+        || !getVarint(p,end,stream) || !getVarint(p,end,count))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    // 文件已被修改或选择了其他视频流，缓存作废
+    if(int64_t(fileSize) != fileSize_ || int64_t(mtime) != mtime_ || int(stream) != streamIndex_)
+        return false;
+
+    std::vector<Entry> entries;
+    entries.reserve(count);
+    int64_t pts = 0, pos = 0;
+    for(uint64_t i = 0; i < count; ++i){
+        uint64_t dPts = 0, dPos = 0;
+        if(!getVarint(p,end,dPts) || !getVarint(p,end,dPos))
+            return false;
+        pts += unzigzag(dPts);
+        pos += unzigzag(dPos);
+        entries.push_back({pts,pos});
+    }
+    entries_.swap(entries);
+    complete_ = true;
+    return true;
+}
+
+bool KeyframeIndex::save() const
+{
+    std::string path;
+    QByteArray data;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        path = cachePath();
+        if(!complete_ || path.empty())
+            return false;
+        data.append(kMagic,4);
+        putVarint(data,uint64_t(fileSize_));
+        putVarint(data,uint64_t(mtime_));
+        putVarint(data,uint64_t(streamIndex_));
+        putVarint(data,entries_.size());
+        // 按增量存储，相邻关键帧的时间戳和偏移差值通常只需1~3字节
+        int64_t pts = 0, pos = 0;
+        for(const Entry& e : entries_){
+            putVarint(data,zigzag(e.pts - pts));
+            putVarint(data,zigzag(e.pos - pos));
+            pts = e.pts;
+            pos = e.pos;
+        }
+    }
+
+    QFileInfo info(QString::fromStdString(path));
+    QDir().mkpath(info.absolutePath());
+    QSaveFile file(info.absoluteFilePath());
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(data);
+    return file.commit();
+}
+
+bool KeyframeIndex::build(const std::atomic<bool> &cancel)
+{
+    std::string url;
+    int streamIndex;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        url = url_;
+        streamIndex = streamIndex_;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // 使用独立的解复用上下文，不影响播放线程
+    AVFormatContext* ctx = nullptr;
+    if(avformat_open_input(&ctx,url.c_str(),nullptr,nullptr) < 0)
+        return false;
+    if(avformat_find_stream_info(ctx,nullptr) < 0 || streamIndex < 0
+        || streamIndex >= int(ctx->nb_streams)){
+        avformat_close_input(&ctx);
+        return false;
+    }
+    // 只解析视频流，其余流在解复用层直接跳过
+    for(unsigned i = 0; i < ctx->nb_streams; ++i)
+        ctx->streams[i]->discard = int(i) == streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+    std::vector<Entry> entries;
+    int64_t packets = 0;
+    int64_t bytes = 0;
+    AVPacket* pkt = av_packet_alloc();
+    while(!cancel && av_read_frame(ctx,pkt) >= 0){
+        if(pkt->stream_index == streamIndex){
+            ++packets;
+            if(pkt->pos >= 0)
+                bytes = std::max(bytes,pkt->pos + pkt->size);
+            int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if((pkt->flags & AV_PKT_FLAG_KEY) && pkt->pos >= 0 && ts != AV_NOPTS_VALUE)
+                entries.push_back({ts,pkt->pos});
+        }
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&ctx);
+
+    if(cancel)
+        return false;
+
+    std::sort(entries.begin(),entries.end(),[](const Entry& a,const Entry& b){
+        return a.pts < b.pts;
+    });
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    qDebug() << "keyframe index built:" << entries.size() << "keyframes,"
+             << packets << "packets," << bytes / (1024.0 * 1024.0) << "MB in" << sec << "s ("
+             << (sec > 0 ? bytes / (1024.0 * 1024.0) / sec : 0.0) << "MB/s,"
+             << (sec > 0 ? packets / sec : 0.0) << "packets/s)";
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(url != url_)
+        return false;
+    entries_.swap(entries);
+    complete_ = true;
+    return true;
+}
+
+bool KeyframeIndex::isComplete() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return complete_;
+}
+
+bool KeyframeIndex::lookup(int64_t pts, Entry &out) const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(!complete_ || entries_.empty())
+        return false;
+    auto it = std::upper_bound(entries_.begin(),entries_.end(),pts,[](int64_t v,const Entry& e){
+        return v < e.pts;
+    });
+    if(it == entries_.begin())
+        out = entries_.front();
+    else
+        out = *(it - 1);
+    return true;
+}
+
+size_t KeyframeIndex::size() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return entries_.size();
+}
+
+int64_t KeyframeIndex::averageGop() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(entries_.size() < 2)
+        return 0;
+    return (entries_.back().pts - entries_.front().pts) / int64_t(entries_.size() - 1);
+}
+
+bool KeyframeIndex::isUsefulFor(const char *formatName)
+{
+    if(!formatName)
+        return false;
+    // 这些容器没有全局索引，av_seek_frame需要在文件中反复读取时间戳定位
+    static const char* const kFormats[] = {"mpegts","mpeg","avi","flv"};
+    for(const char* name : kFormats){
+        if(strcmp(formatName,name) == 0)
+            return true;
+    }
+    return false;
+}
+
+std::string KeyframeIndex::cachePath() const
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if(dir.isEmpty())
+        return std::string();
+    QString absPath = QFileInfo(QString::fromStdString(url_)).absoluteFilePath();
+    QByteArray key = QCryptographicHash::hash(absPath.toUtf8(),QCryptographicHash::Md5).toHex();
+    return QDir(dir).filePath(QStringLiteral("keyframes/") + QString::fromLatin1(key) + QStringLiteral(".kfi")).toStdString();
+}
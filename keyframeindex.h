@@ -0,0 +1,55 @@
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// 视频流关键帧索引：pts -> 文件字节偏移
+// 用于索引缺失或不完整的容器（MPEG-TS、部分AVI/FLV），
+// 跳转时可以直接按字节偏移定位，避免av_seek_frame在文件中二分查找。
+// 索引以紧凑的二进制格式缓存在磁盘上，以文件大小和修改时间判断是否过期。
+class KeyframeIndex
+{
+public:
+    struct Entry{
+        int64_t pts;    // 视频流时间基下的时间戳
+        int64_t pos;    // 包在文件中的字节偏移
+    };
+
+    // 绑定到文件和视频流，清空已有索引
+    void reset(const std::string& url, int streamIndex);
+    // 从磁盘缓存载入，缓存不存在或与文件不匹配时返回false
+    bool load();
+    // 写入磁盘缓存
+    bool save() const;
+
+    // 独立打开文件扫描一遍视频关键帧（不解码），cancel置位时提前返回false
+    bool build(const std::atomic<bool>& cancel);
+
+    bool isComplete() const;
+    // 查找不晚于pts的最后一个关键帧
+    bool lookup(int64_t pts, Entry& out) const;
+    size_t size() const;
+    // 平均GOP长度（以关键帧间隔计，单位为视频流时间基）
+    int64_t averageGop() const;
+
+    // 判断容器是否需要自建索引
+    static bool isUsefulFor(const char* formatName);
+
+private:
+    // 缓存文件路径，需持有锁调用
+    std::string cachePath() const;
+
+    mutable std::mutex mtx_;
+    std::string url_;
+    int streamIndex_ = -1;
+    int64_t fileSize_ = 0;
+    int64_t mtime_ = 0;
+    std::vector<Entry> entries_;
+    bool complete_ = false;
+};
+
+#endif // KEYFRAMEINDEX_H
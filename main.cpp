@@ -1,12 +1,12 @@
 #include "mainwindow.h"
 #include <QApplication>
-#include "yuv420pframe.h"
+#include "videoframe.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
-    // 注册 shared_ptr<Yuv420PFrame>
-    qRegisterMetaType<std::shared_ptr<Yuv420PFrame>>("std::shared_ptr<Yuv420PFrame>");
+    // 注册 shared_ptr<VideoFrame>
+    qRegisterMetaType<std::shared_ptr<VideoFrame>>("std::shared_ptr<VideoFrame>");
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,6 +1,7 @@
 #include "mainwindow.h"
 #include "./ui_mainwindow.h"
 #include "player.h"
+#include "thumbnailprovider.h"
 #include <QFileDialog>
 #include <QDebug>
 #include <QShortcut>
@@ -14,6 +15,9 @@ MainWindow::MainWindow(QWidget *parent)
 
     qApp->installEventFilter(this);
     player = new Player(ui->openGLWidget);
+    // 进度条悬停预览
+    thumbnails = new ThumbnailProvider(this);
+    ui->ctrlBar->setThumbnailProvider(thumbnails);
 
     // 设置播放列表行为
     ui->listWidget->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff); // 不显示横向滚动条
@@ -55,6 +59,7 @@ void MainWindow::connectInit()
             qDebug()<<filePath;
             ui->listWidget->loadFromFile(filePath);
             player->openFile(filePath.toStdString());
+            thumbnails->setFile(filePath.toStdString());
             player->play();
             // 开始播放后应该更新播放/暂停键状态
             emit ui->ctrlBar->updatePlayBtnState(true);
@@ -65,6 +70,7 @@ void MainWindow::connectInit()
     // 连接播放列表双击播放事件
     connect(ui->listWidget,&PlaylistWidget::playRequested,this,[this](const QString& filePath){
         player->openFile(filePath.toStdString());
+        thumbnails->setFile(filePath.toStdString());
         player->play();
         // 开始播放后应该更新播放/暂停键状态
         emit ui->ctrlBar->updatePlayBtnState(true);
@@ -126,6 +132,11 @@ void MainWindow::connectInit()
         this->player->setVolume(vol);
     });
 
+    // 修改播放倍速
+    connect(this->ui->ctrlBar,&CtrlBar::speedChanged,this,[this](double speed){
+        this->player->setSpeed(speed);
+    });
+
     // 修改播放比例
     connect(this->ui->ctrlBar,&CtrlBar::aspectRatioChanged,this,[this](int val){
         ui->openGLWidget->setAspectRatioMode(val);
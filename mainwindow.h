@@ -4,6 +4,7 @@
 #include <QMainWindow>
 #include <QTimer>
 class Player;
+class ThumbnailProvider;
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -27,6 +28,7 @@ private slots:
 private:
     Ui::MainWindow *ui;
     Player* player;
+    ThumbnailProvider* thumbnails;
     QTimer* hideTimer;
 
     // 全屏切换
@@ -0,0 +1,170 @@
+#include "mappedfileio.h"
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+
+#if defined(Q_OS_WIN)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// 读位置前方预读的窗口，剩余不足一半时向前推进。
+// WILLNEED会在调用线程中提交读请求，窗口过大反而拖慢解复用，4MB配合SEQUENTIAL最稳定
+constexpr int64_t kReadAhead = 4 << 20;
+// 读位置后方保留的范围，交错不好的文件会在附近来回读取
+constexpr int64_t kKeepBehind = 64 << 20;
+// 回收攒够这么多再提示一次，减少系统调用
+constexpr int64_t kReleaseBatch = 16 << 20;
+// AVIO缓冲，数据已在内存中，只决定回调的调用频率
+constexpr int kIoBufferSize = 256 << 10;
+
+}
+
+MappedFileIO::~MappedFileIO()
+{
+    if(avio_){
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+    }
+    if(data_)
+        file_.unmap(const_cast<uchar*>(data_));
+    file_.close();
+}
+
+bool MappedFileIO::localPath(const std::string &url, std::string &path)
+{
+    if(url.compare(0,5,"file:") == 0){
+        path = url.substr(5);
+        return true;
+    }
+    if(url.find("://") != std::string::npos)
+        return false;
+    path = url;
+    return true;
+}
+
+std::unique_ptr<MappedFileIO> MappedFileIO::open(const std::string &url)
+{
+    std::string path;
+    if(!localPath(url,path))
+        return nullptr;
+
+    std::unique_ptr<MappedFileIO> io(new MappedFileIO);
+    io->file_.setFileName(QString::fromStdString(path));
+    if(!io->file_.open(QIODevice::ReadOnly))
+        return nullptr;
+    io->size_ = io->file_.size();
+    if(io->size_ <= 0)
+        return nullptr;
+    // Windows上为MapViewOfFile，其他平台为mmap；32位进程映射大文件会失败，回退到默认协议
+    io->data_ = io->file_.map(0,io->size_);
+    if(!io->data_){
+        qDebug() << "mmap failed:" << io->file_.errorString();
+        return nullptr;
+    }
+
+#if defined(Q_OS_WIN)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    io->pageSize_ = info.dwPageSize;
+#elif defined(Q_OS_UNIX)
+    io->pageSize_ = sysconf(_SC_PAGESIZE);
+    // 整体按顺序读取提示，内核会加大预读并尽早回收已读页面
+    madvise(const_cast<uint8_t*>(io->data_),static_cast<size_t>(io->size_),MADV_SEQUENTIAL);
+#endif
+
+    unsigned char* buffer = static_cast<unsigned char*>(av_malloc(kIoBufferSize));
+    if(!buffer)
+        return nullptr;
+    io->avio_ = avio_alloc_context(buffer,kIoBufferSize,0,io.get(),&MappedFileIO::readPacket,nullptr,&MappedFileIO::seek);
+    if(!io->avio_){
+        av_free(buffer);
+        return nullptr;
+    }
+    io->advise();
+    return io;
+}
+
+int MappedFileIO::readPacket(void *opaque, uint8_t *buf, int size)
+{
+    auto* self = static_cast<MappedFileIO*>(opaque);
+    if(self->pos_ >= self->size_)
+        return AVERROR_EOF;
+    int n = static_cast<int>(std::min<int64_t>(size,self->size_ - self->pos_));
+    // 缺页由内核按预读提示从页缓存或磁盘补上
+    memcpy(buf,self->data_ + self->pos_,n);
+    self->pos_ += n;
+    self->stats_.bytesRead += n;
+    self->advise();
+    return n;
+}
+
+int64_t MappedFileIO::seek(void *opaque, int64_t offset, int whence)
+{
+    auto* self = static_cast<MappedFileIO*>(opaque);
+    int64_t pos;
+    switch(whence & ~AVSEEK_FORCE){
+    case AVSEEK_SIZE:
+        return self->size_;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = self->pos_ + offset;
+        break;
+    case SEEK_END:
+        pos = self->size_ + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if(pos < 0)
+        return AVERROR(EINVAL);
+    // 只移动读位置，预读提示留到下次读取时再更新
+    self->pos_ = pos;
+    ++self->stats_.seeks;
+    return pos;
+}
+
+void MappedFileIO::advise()
+{
+    int64_t pageMask = ~(pageSize_ - 1);
+    // 读位置离开已预读的范围（跳转），或前方剩余不足一半窗口时，重新提示预读
+    if(pos_ < aheadBegin_ || pos_ + kReadAhead / 2 > aheadEnd_){
+        int64_t begin = pos_ & pageMask;
+        int64_t end = std::min(size_,pos_ + kReadAhead);
+        if(end > begin){
+#if defined(Q_OS_WIN) && _WIN32_WINNT >= 0x0602
+            WIN32_MEMORY_RANGE_ENTRY range;
+            range.VirtualAddress = const_cast<uint8_t*>(data_ + begin);
+            range.NumberOfBytes = static_cast<SIZE_T>(end - begin);
+            PrefetchVirtualMemory(GetCurrentProcess(),1,&range,0);
+#elif defined(Q_OS_UNIX)
+            madvise(const_cast<uint8_t*>(data_ + begin),static_cast<size_t>(end - begin),MADV_WILLNEED);
+#endif
+            ++stats_.advises;
+        }
+        aheadBegin_ = begin;
+        aheadEnd_ = end;
+    }
+
+#if defined(Q_OS_UNIX)
+    // 向后跳转后，之前提示回收的范围重新从读位置后方算起
+    int64_t keepFrom = std::max<int64_t>(pos_ - kKeepBehind,0) & pageMask;
+    if(keepFrom < releasedEnd_)
+        releasedEnd_ = keepFrom;
+    // 只读的文件映射回收后再访问会从页缓存重新映射，不会丢数据
+    if(keepFrom - releasedEnd_ >= kReleaseBatch){
+        madvise(const_cast<uint8_t*>(data_ + releasedEnd_),static_cast<size_t>(keepFrom - releasedEnd_),MADV_DONTNEED);
+        releasedEnd_ = keepFrom;
+        ++stats_.advises;
+    }
+#endif
+}
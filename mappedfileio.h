@@ -0,0 +1,66 @@
+#ifndef MAPPEDFILEIO_H
+#define MAPPEDFILEIO_H
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <QFile>
+
+extern "C"{
+#include <libavformat/avformat.h>
+}
+
+// 基于内存映射的本地文件AVIOContext
+// 整个文件映射到地址空间，读取只是一次memcpy，跳转只修改读位置，都不产生系统调用。
+// 读位置前方按窗口提示内核预读（madvise WILLNEED / PrefetchVirtualMemory），
+// 读位置后方较远的页面提示可以回收（madvise DONTNEED），避免长时间播放后驻留内存持续增长。
+// 读写回调只在解复用线程中调用。
+// 映射页读取出错或文件被截断时，访问映射内存会触发SIGBUS而不是返回错误，不适合移动存储和网络文件系统。
+class MappedFileIO
+{
+public:
+    struct Stats{
+        uint64_t bytesRead = 0;
+        uint64_t seeks = 0;
+        // 预读/回收提示的调用次数
+        uint64_t advises = 0;
+    };
+
+    ~MappedFileIO();
+    MappedFileIO(const MappedFileIO&) = delete;
+    MappedFileIO& operator=(const MappedFileIO&) = delete;
+
+    // url为本地路径（或file:前缀）时映射文件并创建AVIOContext，否则或映射失败时返回nullptr
+    static std::unique_ptr<MappedFileIO> open(const std::string& url);
+
+    // url为本地文件时取出路径（去掉file:前缀），其他协议返回false
+    static bool localPath(const std::string& url, std::string& path);
+
+    // 交给AVFormatContext::pb使用，所有权仍属于本对象
+    AVIOContext* context() const { return avio_; }
+    int64_t size() const { return size_; }
+    Stats stats() const { return stats_; }
+
+private:
+    MappedFileIO() = default;
+
+    static int readPacket(void* opaque, uint8_t* buf, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+    // 按当前读位置更新预读和回收范围
+    void advise();
+
+    QFile file_;
+    const uint8_t* data_ = nullptr;
+    int64_t size_ = 0;
+    int64_t pos_ = 0;
+    int64_t pageSize_ = 4096;
+    // 已提示预读的范围
+    int64_t aheadBegin_ = 0;
+    int64_t aheadEnd_ = 0;
+    // 此前的页面已提示回收
+    int64_t releasedEnd_ = 0;
+    AVIOContext* avio_ = nullptr;
+    Stats stats_;
+};
+
+#endif // MAPPEDFILEIO_H
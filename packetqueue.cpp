@@ -0,0 +1,226 @@
+#include "packetqueue.h"
+#include <algorithm>
+
+extern "C"{
+#include <libavcodec/avcodec.h>
+}
+
+PacketQueue::PacketQueue(size_t capacity)
+    :lastTs_(AV_NOPTS_VALUE)
+{
+    size_t cap = 2;
+    while(cap < capacity)
+        cap <<= 1;
+    slots_.resize(cap);
+    mask_ = cap - 1;
+}
+
+PacketQueue::~PacketQueue()
+{
+    clear();
+}
+
+bool PacketQueue::push(AVPacket *pkt)
+{
+    return pushBatch(&pkt,1) == 1;
+}
+
+size_t PacketQueue::pushBatch(AVPacket * const *pkts, size_t n)
+{
+    const size_t cap = slots_.size();
+    size_t done = 0;
+    while(done < n){
+        if(stop_.load(std::memory_order_acquire))
+            break;
+
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t freeSlots = cap - (tail - cachedHead_);
+        if(freeSlots == 0){
+            // 缓存的读位置已过期，重新读取
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            freeSlots = cap - (tail - cachedHead_);
+        }
+        if(freeSlots == 0){
+            // 队列已满，挂起直到消费者腾出空间
+            notFull_.wait([&]{
+                return stop_.load(std::memory_order_acquire)
+                       || tail - head_.load(std::memory_order_acquire) < cap;
+            });
+            continue;
+        }
+
+        size_t cnt = std::min(freeSlots,n - done);
+        int64_t addBytes = 0;
+        int64_t addDuration = 0;
+        int serial = serial_.load(std::memory_order_relaxed);
+        for(size_t i = 0; i < cnt; ++i){
+            Slot& slot = slots_[(tail + i) & mask_];
+            slot.pkt = pkts[done + i];
+            slot.durationUs = packetDurationUs(slot.pkt);
+            slot.serial = serial;
+            addBytes += slot.pkt->size;
+            addDuration += slot.durationUs;
+        }
+        // 先计入统计再发布，消费者出队时扣减不会出现负值
+        bytes_.fetch_add(addBytes,std::memory_order_relaxed);
+        durationUs_.fetch_add(addDuration,std::memory_order_relaxed);
+        tail_.store(tail + cnt,std::memory_order_release);
+        done += cnt;
+        notEmpty_.notify();
+    }
+    return done;
+}
+
+AVPacket *PacketQueue::pop(bool blocking, int *serial)
+{
+    AVPacket* pkt = nullptr;
+    if(popBatch(&pkt,1,blocking,serial) == 0)
+        return nullptr;
+    return pkt;
+}
+
+size_t PacketQueue::popBatch(AVPacket **pkts, size_t n, bool blocking, int *serials)
+{
+    size_t cnt = 0;
+    while(cnt == 0){
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t avail = cachedTail_ - head;
+        if(avail == 0){
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            avail = cachedTail_ - head;
+        }
+        if(avail == 0){
+            if(!blocking)
+                return 0;
+            // 队列为空，挂起直到有新包或停止
+            notEmpty_.wait([&]{
+                return stop_.load(std::memory_order_acquire)
+                       || tail_.load(std::memory_order_acquire) != head;
+            });
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            avail = cachedTail_ - head;
+            if(avail == 0)
+                return 0;
+        }
+
+        size_t take = std::min(avail,n);
+        int curSerial = serial_.load(std::memory_order_acquire);
+        int64_t subBytes = 0;
+        int64_t subDuration = 0;
+        for(size_t i = 0; i < take; ++i){
+            Slot& slot = slots_[(head + i) & mask_];
+            subBytes += slot.pkt->size;
+            subDuration += slot.durationUs;
+            if(slot.serial != curSerial){
+                // 跳转前入队的包，直接丢弃
+                av_packet_free(&slot.pkt);
+                continue;
+            }
+            if(serials)
+                serials[cnt] = slot.serial;
+            pkts[cnt++] = slot.pkt;
+            slot.pkt = nullptr;
+        }
+        bytes_.fetch_sub(subBytes,std::memory_order_relaxed);
+        durationUs_.fetch_sub(subDuration,std::memory_order_relaxed);
+        head_.store(head + take,std::memory_order_release);
+        notFull_.notify();
+        if(spaceNotifier_)
+            spaceNotifier_->notify();
+    }
+    return cnt;
+}
+
+void PacketQueue::clear()
+{
+    AVPacket* pkt = nullptr;
+    while(popBatch(&pkt,1,false) == 1){
+        av_packet_free(&pkt);
+    }
+    lastTs_ = AV_NOPTS_VALUE;
+}
+
+void PacketQueue::setStop(bool s)
+{
+    stop_.store(s,std::memory_order_release);
+    notEmpty_.notify();
+    notFull_.notify();
+    if(spaceNotifier_)
+        spaceNotifier_->notify();
+}
+
+size_t PacketQueue::size() const
+{
+    // 先读head再读tail，保证结果不为负
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+}
+
+size_t PacketQueue::capacity() const
+{
+    return slots_.size();
+}
+
+bool PacketQueue::isStopped()const{
+    return stop_.load(std::memory_order_acquire);
+}
+
+void PacketQueue::flush(int serial)
+{
+    serial_.store(serial,std::memory_order_release);
+    lastTs_ = AV_NOPTS_VALUE;
+}
+
+int PacketQueue::serial() const
+{
+    return serial_.load(std::memory_order_acquire);
+}
+
+void PacketQueue::setTimeBase(AVRational tb)
+{
+    timeBase_ = tb;
+}
+
+int64_t PacketQueue::bytes() const
+{
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+int64_t PacketQueue::durationUs() const
+{
+    return durationUs_.load(std::memory_order_relaxed);
+}
+
+bool PacketQueue::isFull(const QueueWatermarks &wm) const
+{
+    return bytes() >= wm.highBytes || durationUs() >= wm.highDurationUs;
+}
+
+bool PacketQueue::isHungry(const QueueWatermarks &wm) const
+{
+    return bytes() < wm.lowBytes || durationUs() < wm.lowDurationUs;
+}
+
+int64_t PacketQueue::packetDurationUs(const AVPacket *pkt)
+{
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    int64_t dur = pkt->duration;
+    if(dur <= 0 && ts != AV_NOPTS_VALUE && lastTs_ != AV_NOPTS_VALUE && ts > lastTs_)
+        dur = ts - lastTs_;
+    if(ts != AV_NOPTS_VALUE)
+        lastTs_ = ts;
+    if(dur <= 0)
+        return 0;
+    return av_rescale_q(dur,timeBase_,AVRational{1,AV_TIME_BASE});
+}
+
+void PacketQueue::setSpaceNotifier(WaitNotifier *notifier)
+{
+    spaceNotifier_ = notifier;
+}
+
+uint64_t PacketQueue::wakeups() const
+{
+    return notEmpty_.wakeups() + notFull_.wakeups();
+}
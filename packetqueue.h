@@ -0,0 +1,107 @@
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+#include "waitnotifier.h"
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+extern "C"{
+#include <libavutil/rational.h>
+}
+
+struct AVPacket;
+
+// 单个包队列的缓冲水位，字节数与缓冲时长（微秒）任一项超过high即视为已满，
+// 任一项低于low即视为饥饿
+struct QueueWatermarks{
+    int64_t lowBytes = 0;
+    int64_t highBytes = 0;
+    int64_t lowDurationUs = 0;
+    int64_t highDurationUs = 0;
+};
+
+// 有界单生产者/单消费者包队列
+// 生产者为解复用线程，消费者为对应的解码线程，push/pop均不加锁，
+// 只有在队列空/满需要挂起时才经过WaitNotifier的慢路径。
+// 每个包带有入队时的序列号，跳转时生产者调用flush()切换序列号，
+// 消费者出队时自动丢弃旧序列号的包
+
+class PacketQueue{
+public:
+    // capacity会向上取整为2的幂
+    explicit PacketQueue(size_t capacity = 1024);
+    ~PacketQueue();
+    PacketQueue(const PacketQueue&) = delete;
+    PacketQueue& operator=(const PacketQueue&) = delete;
+
+    // 队列满时阻塞，返回false表示队列已停止，包所有权仍归调用方
+    bool push(AVPacket* pkt);
+    // 批量入队，返回实际入队数量（仅在停止时小于n）
+    size_t pushBatch(AVPacket* const* pkts, size_t n);
+    // serial非空时返回包的序列号
+    AVPacket* pop(bool blocking = true, int* serial = nullptr);
+    // 批量出队，最多取n个，返回实际数量
+    size_t popBatch(AVPacket** pkts, size_t n, bool blocking = true, int* serials = nullptr);
+    // 切换到新的序列号，之前入队的包都作废（生产者调用）
+    void flush(int serial);
+    int serial()const;
+    // 释放队列中所有包，只能在生产者与消费者都不活动时调用
+    void clear();
+    void setStop(bool s);
+    size_t size()const;
+    size_t capacity()const;
+    bool isStopped()const;
+
+    // 设置所属流的时间基，用于把包时长换算成微秒
+    void setTimeBase(AVRational tb);
+    // 队列中包数据的总字节数
+    int64_t bytes()const;
+    // 队列中包的总时长（微秒）
+    int64_t durationUs()const;
+    // 是否达到高水位
+    bool isFull(const QueueWatermarks& wm)const;
+    // 是否低于低水位
+    bool isHungry(const QueueWatermarks& wm)const;
+
+    // 消费者每次出队后额外通知的对象，供生产者按水位而不是按槽位等待
+    void setSpaceNotifier(WaitNotifier* notifier);
+    // 队列内部挂起线程的累计唤醒次数
+    uint64_t wakeups()const;
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    struct Slot{
+        AVPacket* pkt = nullptr;
+        int64_t durationUs = 0;
+        int serial = 0;
+    };
+
+    // 计算包时长，包本身没有时长时用相邻包的时间戳差估算（生产者调用）
+    int64_t packetDurationUs(const AVPacket* pkt);
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+
+    // 生产者独占的缓存行：写位置 + 缓存的读位置
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+    size_t cachedHead_ = 0;
+    int64_t lastTs_;
+    AVRational timeBase_{1,1000000};
+
+    // 消费者独占的缓存行：读位置 + 缓存的写位置
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
+    size_t cachedTail_ = 0;
+
+    alignas(kCacheLine) std::atomic<bool> stop_{false};
+    std::atomic<int> serial_{0};
+    std::atomic<int64_t> bytes_{0};
+    std::atomic<int64_t> durationUs_{0};
+
+    WaitNotifier notEmpty_;
+    WaitNotifier notFull_;
+    WaitNotifier* spaceNotifier_ = nullptr;
+};
+
+#endif // PACKETQUEUE_H
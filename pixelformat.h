@@ -0,0 +1,118 @@
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+
+extern "C"{
+#include <libavutil/pixfmt.h>
+}
+
+// 渲染端支持的像素格式特性
+// 每种原生格式在编译期确定平面布局、色度采样和取值范围，
+// VideoWidget据此选择着色器变体和纹理尺寸；其余格式由解码线程转换为YUV420P。
+// 10/12位格式同样原生渲染：平面以16位纹理上传，由着色器归一化。
+
+// 着色器变体的平面布局
+enum class PlaneLayout{
+    Planar,     // Y、U、V三个平面
+    SemiPlanar  // Y平面 + UV交错平面（NV12）
+};
+
+template<PlaneLayout L, int ShiftW, int ShiftH, bool FullRange, int Depth = 8, bool MsbAligned = false>
+struct NativePixelFormat{
+    static constexpr bool native = true;
+    static constexpr PlaneLayout layout = L;
+    // 色度平面相对亮度平面的缩小倍数（右移位数）
+    static constexpr int chromaShiftW = ShiftW;
+    static constexpr int chromaShiftH = ShiftH;
+    // 是否为全范围（0~255），否则为有限范围（16~235）
+    static constexpr bool fullRange = FullRange;
+    // 每个分量的有效位数，大于8时每个采样占16位
+    static constexpr int bitDepth = Depth;
+    // 有效位位于16位的高位（P010），否则位于低位（yuv420p10le）
+    static constexpr bool msbAligned = MsbAligned;
+};
+
+template<AVPixelFormat F>
+struct PixelFormatTraits{
+    static constexpr bool native = false;
+};
+
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUV420P>  : NativePixelFormat<PlaneLayout::Planar,1,1,false>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUVJ420P> : NativePixelFormat<PlaneLayout::Planar,1,1,true>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUV422P>  : NativePixelFormat<PlaneLayout::Planar,1,0,false>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUVJ422P> : NativePixelFormat<PlaneLayout::Planar,1,0,true>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUV444P>  : NativePixelFormat<PlaneLayout::Planar,0,0,false>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUVJ444P> : NativePixelFormat<PlaneLayout::Planar,0,0,true>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_NV12>     : NativePixelFormat<PlaneLayout::SemiPlanar,1,1,false>{};
+// 高位深格式以16位纹理上传，在着色器中归一化
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUV420P10LE> : NativePixelFormat<PlaneLayout::Planar,1,1,false,10>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUV420P12LE> : NativePixelFormat<PlaneLayout::Planar,1,1,false,12>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUV422P10LE> : NativePixelFormat<PlaneLayout::Planar,1,0,false,10>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_YUV444P10LE> : NativePixelFormat<PlaneLayout::Planar,0,0,false,10>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_P010LE>      : NativePixelFormat<PlaneLayout::SemiPlanar,1,1,false,10,true>{};
+template<> struct PixelFormatTraits<AV_PIX_FMT_P016LE>      : NativePixelFormat<PlaneLayout::SemiPlanar,1,1,false,16,true>{};
+
+// 运行时使用的格式信息，由编译期特性生成
+struct PixelFormatInfo{
+    PlaneLayout layout = PlaneLayout::Planar;
+    int chromaShiftW = 1;
+    int chromaShiftH = 1;
+    bool fullRange = false;
+    int bitDepth = 8;
+    bool msbAligned = false;
+
+    // 每个分量占用的字节数
+    int bytesPerComponent() const { return bitDepth > 8 ? 2 : 1; }
+    // 纹理采样值（按存储位宽归一化）乘以该系数后，与8位格式的归一化值一致，
+    // 这样有限范围的16/235等常量对所有位深通用
+    float sampleScale() const {
+        if(bitDepth <= 8)
+            return 1.0f;
+        int shift = msbAligned ? 16 - bitDepth : 0;
+        return 65535.0f / static_cast<float>((255 << (bitDepth - 8)) << shift);
+    }
+    // 截为8位时的右移位数，保留有效位的最高8位
+    int narrowShift() const {
+        return msbAligned ? 8 : bitDepth - 8;
+    }
+};
+
+template<AVPixelFormat F>
+constexpr PixelFormatInfo pixelFormatInfo()
+{
+    using T = PixelFormatTraits<F>;
+    static_assert(T::native, "pixel format has no native shader");
+    return PixelFormatInfo{T::layout,T::chromaShiftW,T::chromaShiftH,T::fullRange,T::bitDepth,T::msbAligned};
+}
+
+// 查找原生格式的信息，不支持的格式返回false
+inline bool lookupPixelFormat(int format, PixelFormatInfo& info)
+{
+    switch(format){
+    case AV_PIX_FMT_YUV420P:  info = pixelFormatInfo<AV_PIX_FMT_YUV420P>();  return true;
+    case AV_PIX_FMT_YUVJ420P: info = pixelFormatInfo<AV_PIX_FMT_YUVJ420P>(); return true;
+    case AV_PIX_FMT_YUV422P:  info = pixelFormatInfo<AV_PIX_FMT_YUV422P>();  return true;
+    case AV_PIX_FMT_YUVJ422P: info = pixelFormatInfo<AV_PIX_FMT_YUVJ422P>(); return true;
+    case AV_PIX_FMT_YUV444P:  info = pixelFormatInfo<AV_PIX_FMT_YUV444P>();  return true;
+    case AV_PIX_FMT_YUVJ444P: info = pixelFormatInfo<AV_PIX_FMT_YUVJ444P>(); return true;
+    case AV_PIX_FMT_NV12:     info = pixelFormatInfo<AV_PIX_FMT_NV12>();     return true;
+    case AV_PIX_FMT_YUV420P10LE: info = pixelFormatInfo<AV_PIX_FMT_YUV420P10LE>(); return true;
+    case AV_PIX_FMT_YUV420P12LE: info = pixelFormatInfo<AV_PIX_FMT_YUV420P12LE>(); return true;
+    case AV_PIX_FMT_YUV422P10LE: info = pixelFormatInfo<AV_PIX_FMT_YUV422P10LE>(); return true;
+    case AV_PIX_FMT_YUV444P10LE: info = pixelFormatInfo<AV_PIX_FMT_YUV444P10LE>(); return true;
+    case AV_PIX_FMT_P010LE:      info = pixelFormatInfo<AV_PIX_FMT_P010LE>();      return true;
+    case AV_PIX_FMT_P016LE:      info = pixelFormatInfo<AV_PIX_FMT_P016LE>();      return true;
+    default:
+        return false;
+    }
+}
+
+inline bool isNativePixelFormat(int format)
+{
+    PixelFormatInfo info;
+    return lookupPixelFormat(format,info);
+}
+
+// 无原生着色器的格式转换成的目标格式
+constexpr AVPixelFormat kFallbackPixelFormat = AV_PIX_FMT_YUV420P;
+
+#endif // PIXELFORMAT_H
@@ -3,60 +3,13 @@
 
 #include "player.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
 #include <QDebug>
-#include "yuv420pframe.h"
+#include "videoframe.h"
 
 
-void PacketQueue::push(AVPacket *pkt)
-{
-    std::lock_guard<std::mutex> lock(mtx_);
-    q_.push(pkt);
-    cv_.notify_one();
-}
-
-AVPacket *PacketQueue::pop(bool blocking)
-{
-    std::unique_lock<std::mutex> lock(mtx_);
-    if(blocking){
-        cv_.wait(lock,[&]{
-            return !q_.empty() || this->stop_;
-        });
-    }
-    if(q_.empty()) return nullptr;
-    AVPacket* pkt = q_.front();
-    q_.pop();
-    return pkt;
-}
-
-
-void PacketQueue::clear()
-{
-    std::lock_guard<std::mutex> lock(mtx_);
-    while(!q_.empty()){
-        AVPacket* pkt = q_.front();
-        q_.pop();
-        av_packet_free(&pkt);
-    }
-}
-
-void PacketQueue::setStop(bool s)
-{
-    std::lock_guard<std::mutex> lock(mtx_);
-    stop_ = s;
-    cv_.notify_all();
-}
-
-size_t PacketQueue::size() const
-{
-    std::lock_guard<std::mutex> lock(mtx_);
-    return q_.size();
-}
-
-bool PacketQueue::isStopped()const{
-    std::lock_guard<std::mutex> lock(mtx_);
-    return stop_;
-}
-
 Player::Player(VideoWidget *videoWidget)
     :videoWidget_(videoWidget)
 {
@@ -68,11 +21,16 @@ Player::Player(VideoWidget *videoWidget)
 
     // 初始化播放器状态为停止
     state_ = MediaState::Stop;
+
+    // 解码线程取走数据包后唤醒等待缓冲空间的解复用线程
+    audioPktQ_.setSpaceNotifier(&demuxNotifier_);
+    videoPktQ_.setSpaceNotifier(&demuxNotifier_);
 }
 
 Player::~Player()
 {
     stop();
+    stopKeyframeIndex();
     SDL_Quit();
 }
 
@@ -102,13 +60,24 @@ bool Player::play()
 
     running_ = true;
     paused_ = false;
+    demuxLimits_ = bufferLimits_;
+    demuxThrottled_ = false;
+    isEof_ = false;
 
     audioPktQ_.setStop(false);
     videoPktQ_.setStop(false);
+    frameQ_.setDepth(frameQueueDepth_);
+    frameQ_.setAbort(false);
 
     demuxThread_ = std::thread(&Player::demuxThreadFunc,this);
     audioThread_ = std::thread(&Player::audioThreadFunc,this);
     videoThread_ = std::thread(&Player::videoThreadFunc,this);
+    // 显示时刻由调度器按vsync决定，以音频时钟为准
+    PresentScheduler* scheduler = videoWidget_->presentScheduler();
+    scheduler->flush(seekSerial_);
+    scheduler->setPaused(false);
+    scheduler->setClock([this]{ return audioPlayer_->getAudioClock(); });
+    presentThread_ = std::thread(&Player::presentThreadFunc,this);
 
     // 更新音量
     audioPlayer_->setVolume(volume_);
@@ -117,7 +86,6 @@ bool Player::play()
     //audioPlayer_->setSpeed_(1.2f);
     // 更新播放状态
     state_ = MediaState::Play;
-    isEof_ = false;
     qDebug()<<"call play";
     return true;
 }
@@ -135,6 +103,9 @@ void Player::pause()
     // 播放/暂停音频设备
     if(audioPlayer_)
         audioPlayer_->pause(paused_);
+    videoWidget_->presentScheduler()->setPaused(p);
+    // 唤醒在暂停状态上等待的线程
+    stateNotifier_.notify();
     qDebug()<<"call pause";
 }
 
@@ -147,13 +118,21 @@ void Player::stop()
 
         running_ = false;
         paused_ = false;
+        seekReq_ = false;
         //isEof_ = true;
      }// 提前释放锁
 
+    // 唤醒所有等待中的线程
+    stateNotifier_.notify();
+    demuxNotifier_.notify();
 
     // 停止包队列
     audioPktQ_.setStop(true);
     videoPktQ_.setStop(true);
+    frameQ_.setAbort(true);
+    // 调度器不再读取即将销毁的音频时钟
+    videoWidget_->presentScheduler()->setClock(nullptr);
+    videoWidget_->presentScheduler()->flush();
 
     if(demuxThread_.joinable())
         demuxThread_.join();
@@ -161,6 +140,9 @@ void Player::stop()
     if(videoThread_.joinable())
         videoThread_.join();
 
+    if(presentThread_.joinable())
+        presentThread_.join();
+
     // 此处如果音频输出器是暂停状态会导致死锁
     // 因此退出音频线程前，需要修改音频输出器暂停状态
     audioPlayer_->pause(false);
@@ -181,10 +163,14 @@ void Player::stop()
         avformat_close_input(&fmtCtx_);
         fmtCtx_ = nullptr;
     }
+    // 自定义AVIOContext不随avformat_close_input释放
+    mappedIo_.reset();
+    prefetchIo_.reset();
 
 
     isEof_ = false;
     audioClock_ = 0.0;
+    clockSerial_ = -1;
     initCtx_.store(false);
 
     // 更新播放状态
@@ -195,14 +181,11 @@ void Player::stop()
 
 }
 
-void Player::seek(double pos) {
+void Player::seek(double pos, SeekMode mode) {
+    std::unique_lock<std::mutex> lock(mtx_);
     if (!fmtCtx_ || videoStreamIndex_ < 0 || audioStreamIndex_ < 0)
         return;
 
-
-    stop();
-    // 初始化ffmpeg上下文信息
-    initFFmpegCtx();
     // 获取总时长（微秒）
     int64_t duration = fmtCtx_->duration;
     if (duration <= 0)
@@ -210,20 +193,23 @@ void Player::seek(double pos) {
 
     // 计算目标位置（秒）
     double sec = (pos * static_cast<double>(duration))/double(1000000);
-    int64_t m_nSeekingPos = (int64_t)sec / av_q2d(fmtCtx_->streams[videoStreamIndex_]->time_base);
 
+    // 跳转由解复用线程执行，线程、解码器和音频设备都保持不变
+    seekTarget_ = sec;
+    seekAccurate_ = mode == SeekMode::Accurate;
+    seekReq_ = true;
+    bool running = running_;
+    lock.unlock();
 
-    // 执行跳转（使用视频流作为参考）
-    if (av_seek_frame(fmtCtx_,videoStreamIndex_ , m_nSeekingPos, AVSEEK_FLAG_BACKWARD) < 0) {
-        qDebug() << "Seek failed";
-        return;
+    if(running){
+        // 唤醒可能在暂停、文件末尾或缓冲满处等待的解复用线程
+        stateNotifier_.notify();
+        demuxNotifier_.notify();
+    }else{
+        // 已打开但未播放，启动后解复用线程会先执行跳转
+        play();
     }
 
-    // 重置时钟标志，解复用线程在跳转后读到第一个音频包的情况下，会计算pts传到音频时钟以实现同步
-    seekChangeClock_ = true;
-    // 重新开始解复用 解码
-    play();
-
     qDebug() << "Seek to:" << pos << "(" << sec << "s)";
 }
 
@@ -239,52 +225,38 @@ float Player::getVolume() const {
     return volume_;
 }
 
-// void Player::seek(double pos) {
-//     std::unique_lock<std::mutex> lock(mtx_);
-
-//     if (!fmtCtx_ || !running_)
-//         return;
-
-//     // 1. 暂停播放但不释放资源
-//     lock.unlock();
-//     pause();
-//     lock.lock();
-//     audioPlayer_->setSeeking(true);
-//     std::this_thread::sleep_for(std::chrono::milliseconds(500));
-//     // 2. 清空数据包队列
-//     audioPktQ_.clear();
-//     videoPktQ_.clear();
-//     audioPlayer_->clearBuf();
-
-//     // 3. 刷新解码器
-//     if (audioCtx_) avcodec_flush_buffers(audioCtx_);
-//     if (videoCtx_) avcodec_flush_buffers(videoCtx_);
-
-//     // 4. 计算跳转位置
-//     int64_t target_us = static_cast<int64_t>(pos * fmtCtx_->duration);
-
-//     // 5. 执行跳转（关键修改）
-//     int ret = av_seek_frame(fmtCtx_, -1, target_us, AVSEEK_FLAG_BACKWARD);
-//     if (ret < 0) {
-//         qDebug() << "Seek failed:" ;//<< av_err2str(ret);
-//         return;
-//     }
-
-//     // 6. 重置时钟
-//     audioClock_ = static_cast<double>(target_us) / AV_TIME_BASE;
-//     if(audioPlayer_) {
-//         audioPlayer_->setAudioClock(audioClock_);
-//     }
-
-//     // 7. 重置状态
-//     isEof_ = false;
-//     audioPlayer_->setSeeking(false);
-//     // 8. 恢复播放
-//     lock.unlock();
-//     pause();
-//     lock.lock();
-//     qDebug() << "Seek to:" << pos;
-// }
+void Player::setSpeed(double speed)
+{
+    speed_ = std::clamp(speed,0.5,2.0);
+    qDebug() << "playback speed:" << speed_.load();
+}
+
+double Player::speed() const
+{
+    return speed_;
+}
+
+void Player::setDemuxBufferLimits(const DemuxBufferLimits &limits)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    bufferLimits_ = limits;
+}
+
+void Player::setFrameQueueDepth(int depth)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    frameQueueDepth_ = std::clamp(depth,1,FrameQueue::kMaxDepth);
+}
+
+int Player::frameQueueDepth() const
+{
+    return frameQ_.depth();
+}
+
+int Player::frameQueueSize() const
+{
+    return frameQ_.size();
+}
 
 MediaState Player::getState() const
 {
@@ -294,8 +266,35 @@ MediaState Player::getState() const
 bool Player::initFFmpegCtx()
 {
     stop();
+    IoMode mode;
+    size_t prefetchWindow;
+    DecoderThreadingPolicy threading;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        mode = ioMode_;
+        prefetchWindow = prefetchWindow_;
+        threading = threadingPolicy_;
+    }
+    AVIOContext* pb = nullptr;
+    if(mode == IoMode::Mapped && (mappedIo_ = MappedFileIO::open(url_)))
+        pb = mappedIo_->context();
+    else if(mode == IoMode::Prefetch && (prefetchIo_ = PrefetchFileIO::open(url_,prefetchWindow)))
+        pb = prefetchIo_->context();
+    else
+        mode = IoMode::Default;
+    if(pb){
+        // 设置了pb后avformat_open_input不再打开文件，直接从自定义的AVIOContext读取
+        fmtCtx_ = avformat_alloc_context();
+        fmtCtx_->pb = pb;
+    }
+    activeIoMode_ = static_cast<int>(mode);
+    demuxPackets_ = 0;
+    demuxBytes_ = 0;
+    demuxReadNs_ = 0;
     int ret = avformat_open_input(&fmtCtx_,url_.c_str(),nullptr,nullptr);
     if(ret < 0){
+        mappedIo_.reset();
+        prefetchIo_.reset();
         std::cerr<<"打开文件失败"<<std::endl;
         return false;
     }
@@ -308,12 +307,13 @@ bool Player::initFFmpegCtx()
     audioStreamIndex_ = -1;
     videoStreamIndex_ = -1;
 
-    for(unsigned i = 0; i < fmtCtx_->nb_streams; ++i){
-        if(fmtCtx_->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-            audioStreamIndex_ = i;
-        if(fmtCtx_->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-            videoStreamIndex_ = i;
+    TrackSelection wanted;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        wanted = trackSelection_;
     }
+    videoStreamIndex_ = selectStream(fmtCtx_,AVMEDIA_TYPE_VIDEO,wanted.video,-1);
+    audioStreamIndex_ = selectStream(fmtCtx_,AVMEDIA_TYPE_AUDIO,wanted.audio,videoStreamIndex_);
     if(audioStreamIndex_ < 0){
         std::cerr<<"未找到音频流"<<std::endl;
         return false;
@@ -322,13 +322,22 @@ bool Player::initFFmpegCtx()
         std::cerr<<"未找到视频流"<<std::endl;
         return false;
     }
+    // 未选中的流（字幕、其他音轨、附件等）在解复用层直接跳过，不再读出后丢弃
+    for(unsigned i = 0; i < fmtCtx_->nb_streams; ++i){
+        bool used = static_cast<int>(i) == audioStreamIndex_ || static_cast<int>(i) == videoStreamIndex_;
+        fmtCtx_->streams[i]->discard = used ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+    qDebug() << "streams:" << fmtCtx_->nb_streams << "video:" << videoStreamIndex_ << "audio:" << audioStreamIndex_;
     audioStream_ = fmtCtx_->streams[audioStreamIndex_];
     videoStream_ = fmtCtx_->streams[videoStreamIndex_];
+    audioPktQ_.setTimeBase(audioStream_->time_base);
+    videoPktQ_.setTimeBase(videoStream_->time_base);
     // 视频总时长
     duration_ = fmtCtx_->duration;
 
-    openCodecs();
+    openCodecs(threading);
     openAudio();
+    startKeyframeIndex(false);
     initCtx_.store(true);
     qDebug()<<"call initFFmpegCtx";
     return true;
@@ -338,19 +347,27 @@ void Player::demuxThreadFunc()
 {
     while(running_){
 
+        // 处理跳转请求，暂停时同样处理
+        if(seekReq_){
+            handleSeekRequest();
+            continue;
+        }
+
+        // 暂停时挂起，直到继续播放、跳转或停止
         if(paused_){
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            stateNotifier_.wait([this]{ return !running_ || !paused_ || seekReq_; });
             continue;
         }
 
-        // 如果已经读取到结尾了，休眠等待
+        // 如果已经读取到结尾了，挂起直到跳转或停止
         if(isEof_){
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            stateNotifier_.wait([this]{ return !running_ || seekReq_; });
             continue;
         }
 
-        if(audioPktQ_.size() >= maxAudioPkts_ && videoPktQ_.size() >= maxVideoPkts_){
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        // 缓冲已满，挂起直到解码线程取走数据
+        if(demuxBufferFull()){
+            demuxNotifier_.wait([this]{ return !running_ || seekReq_ || !demuxBufferFull(); });
             continue;
         }
 
@@ -358,36 +375,69 @@ void Player::demuxThreadFunc()
         if(!pkt){
             continue;
         }
+        auto readStart = std::chrono::steady_clock::now();
         int ret = av_read_frame(fmtCtx_,pkt);
+        demuxReadNs_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - readStart).count();
+        if(ret >= 0){
+            ++demuxPackets_;
+            demuxBytes_ += pkt->size;
+        }
         if(ret < 0){
+            av_packet_free(&pkt);
             if(ret == AVERROR_EOF && !isEof_){
                 isEof_ = true;
-                audioPktQ_.setStop(true);
-                videoPktQ_.setStop(true);
-                av_packet_free(&pkt);
-                //break;
+                // 向两个队列各送一个空包，解码线程收到后冲刷解码器
+                AVPacket* audioEof = av_packet_alloc();
+                if(!audioPktQ_.push(audioEof))
+                    av_packet_free(&audioEof);
+                AVPacket* videoEof = av_packet_alloc();
+                if(!videoPktQ_.push(videoEof))
+                    av_packet_free(&videoEof);
             }
-            av_packet_free(&pkt);
             continue;
         }
 
         if (pkt->stream_index == audioStreamIndex_) {
-            if(seekChangeClock_){
-                // 计算PTS
-                double pts = pkt->pts * av_q2d(audioStream_->time_base);
-                audioPlayer_->setAudioClock(pts);
-
-                seekChangeClock_ = false;
-            }
-            audioPktQ_.push(pkt);
+            // 队列已停止时入队失败，由这里释放
+            if(!audioPktQ_.push(pkt))
+                av_packet_free(&pkt);
         }
         else if(pkt->stream_index == videoStreamIndex_){
-            videoPktQ_.push(pkt);
+            if(!videoPktQ_.push(pkt))
+                av_packet_free(&pkt);
         }else{
             av_packet_free(&pkt);
         }
 
 
+    }
+    DemuxStats stats = demuxStats();
+    const char* modeName = stats.mode == IoMode::Mapped ? "mmap" : stats.mode == IoMode::Prefetch ? "prefetch" : "default";
+    qDebug() << "demux" << modeName << "packets:" << stats.packets
+             << "MB:" << stats.bytes / double(1 << 20) << "read time:" << stats.readSeconds << "s"
+             << "packets/s:" << stats.packetsPerSecond() << "MB/s:" << stats.megabytesPerSecond();
+    if(mappedIo_){
+        MappedFileIO::Stats io = mappedIo_->stats();
+        qDebug() << "mmap io read MB:" << io.bytesRead / double(1 << 20) << "seeks:" << io.seeks << "advises:" << io.advises;
+    }
+    if(prefetchIo_){
+        PrefetchFileIO::Stats io = prefetchIo_->stats();
+        qDebug() << "prefetch io" << (io.uring ? "io_uring" : "sync") << "reads:" << io.reads
+                 << "stalls:" << io.stalls << "stall time:" << io.stallSeconds << "s"
+                 << "slow reads:" << io.slowReads << "stalls avoided:" << io.stallsAvoided
+                 << "blocks:" << io.blocks << "MB:" << io.bytes / double(1 << 20);
+        // 块读取延迟直方图，每格的上限（微秒）及次数
+        QString hist;
+        for(int i = 0; i < PrefetchFileIO::kLatencyBuckets; ++i){
+            if(io.latency[i] == 0)
+                continue;
+            QString bound = i == PrefetchFileIO::kLatencyBuckets - 1
+                                ? QStringLiteral(">=%1").arg(PrefetchFileIO::kLatencyBase << (i - 1))
+                                : QStringLiteral("<%1").arg(PrefetchFileIO::kLatencyBase << i);
+            hist += QStringLiteral(" %1us:%2").arg(bound).arg(io.latency[i]);
+        }
+        qDebug() << "prefetch latency" << hist;
     }
     qDebug()<<"demux quit";
 }
@@ -396,40 +446,57 @@ void Player::audioThreadFunc()
 {
     AVFrame* frame = av_frame_alloc();
     int bytesPerSample = av_get_bytes_per_sample(outFmt_) * outChannels_;
-    while(running_){
-        while(paused_ && running_){
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    AVRational atb = audioStream_->time_base;
+    // 当前解码的包序列号，序列号变化说明发生了跳转
+    int serial = -1;
+    // 是否需要用下一帧的时间戳重设音频时钟
+    bool syncClock = false;
+    // 精确跳转时丢弃该时间点之前的采样
+    double dropBefore = -1.0;
+    // 变速时重采样输出先进入变速处理器，1.0倍时旁路
+    TimeStretch stretch;
+    stretch.configure(outRate_,outChannels_);
+    std::vector<uint8_t> stretchIn;
+    double curSpeed = 1.0;
+    // 把变速处理器已产生的输出全部写入音频缓冲区，返回false表示已停止
+    // 慢速时输出比输入多，可能超过缓冲区一次可写入的量，按实际预留的长度分段取出
+    auto drainStretch = [&]{
+        int avail;
+        while((avail = stretch.available()) > 0){
+            size_t granted = 0;
+            uint8_t* out = audioPlayer_->beginWrite(static_cast<size_t>(avail) * bytesPerSample,&granted);
+            if(!out)
+                return false;
+            int frames = std::min(avail,static_cast<int>(granted / bytesPerSample));
+            audioPlayer_->commitWrite(static_cast<size_t>(stretch.pull(reinterpret_cast<float*>(out),frames)) * bytesPerSample);
         }
+        return true;
+    };
+    while(running_){
+        stateNotifier_.wait([this]{ return !running_ || !paused_; });
         if(!running_){
             break;
         }
 
-        AVPacket* pkt = audioPktQ_.pop(true);
+        int pktSerial = 0;
+        AVPacket* pkt = audioPktQ_.pop(true,&pktSerial);
         if(!pkt){
-            if(audioPktQ_.isStopped()){
-                avcodec_send_packet(audioCtx_,nullptr);
-                while(avcodec_receive_frame(audioCtx_,frame) ==0){
-                    /*重采样，计算大小*/
-                    int dst_nb_samples = av_rescale_rnd(
-                        swr_get_delay(swrCtx_, frame->sample_rate) + frame->nb_samples,
-                        outRate_, frame->sample_rate, AV_ROUND_UP);
-
-                    int buf_size = av_samples_get_buffer_size(
-                        nullptr, outChannels_, dst_nb_samples, outFmt_, 1);
-
-                    uint8_t* audio_buf = (uint8_t*)av_malloc(buf_size);
-                    int audio_buf_size = swr_convert(swrCtx_, &audio_buf, dst_nb_samples,
-                                                     (const uint8_t**)frame->data, frame->nb_samples) * bytesPerSample;
-
-                    audioPlayer_->enqueue(audio_buf,audio_buf_size);
-                    av_free(audio_buf);
-                }
-                break;
-            }
-
             continue;
         }
 
+        if(pktSerial != serial){
+            // 丢弃解码器和重采样器中残留的旧数据
+            avcodec_flush_buffers(audioCtx_);
+            if(swrCtx_)
+                swr_init(swrCtx_);
+            stretch.clear();
+            serial = pktSerial;
+            syncClock = true;
+            dropBefore = dropBefore_;
+        }
+
+        // 空包表示文件结束，送入解码器后会输出剩余的帧
+        bool eof = pkt->data == nullptr && pkt->size == 0;
         int ret = avcodec_send_packet(audioCtx_,pkt);
         av_packet_free(&pkt);
         if(ret < 0)
@@ -447,22 +514,106 @@ void Player::audioThreadFunc()
                 break;
             }
 
-            {
-                /*重采样，计算大小*/
-                int dst_nb_samples = av_rescale_rnd(
-                    swr_get_delay(swrCtx_, frame->sample_rate) + frame->nb_samples,
-                    outRate_, frame->sample_rate, AV_ROUND_UP);
+            int64_t ts = frame->best_effort_timestamp != AV_NOPTS_VALUE
+                             ? frame->best_effort_timestamp : frame->pts;
+            double pts = ts != AV_NOPTS_VALUE ? ts * av_q2d(atb) : -1.0;
+
+            // 精确跳转：整帧都在目标之前则直接丢弃，跨过目标的帧去掉开头部分
+            int skipSamples = 0;
+            if(dropBefore >= 0 && pts >= 0){
+                double frameEnd = pts + double(frame->nb_samples) / frame->sample_rate;
+                if(frameEnd <= dropBefore){
+                    av_frame_unref(frame);
+                    continue;
+                }
+                if(pts < dropBefore){
+                    skipSamples = static_cast<int>((dropBefore - pts) * outRate_);
+                    pts = dropBefore;
+                }
+            }
+            dropBefore = -1.0;
+
+            if(syncClock){
+                // 跳转后的第一帧：清掉旧音频，并以该帧时间戳作为音频时钟
+                audioPlayer_->clearBuf();
+                if(pts >= 0)
+                    audioPlayer_->setAudioClock(pts);
+                clockSerial_ = serial;
+                syncClock = false;
+                // 唤醒等待时钟同步的视频线程
+                stateNotifier_.notify();
+            }
 
-                int buf_size = av_samples_get_buffer_size(
-                    nullptr, outChannels_, dst_nb_samples, outFmt_, 1);
+            double speed = speed_;
+            if(speed != curSpeed){
+                // 音频时钟按写入的数据量和倍速切换点推进：旧倍速下已产生的输出在切换点之前写入，
+                // 退出变速时处理器中剩余的输入原速接在切换点之后，时钟不会因丢弃残留而落后
+                if(!drainStretch()){
+                    av_frame_unref(frame);
+                    break;
+                }
+                audioPlayer_->setSpeed_(static_cast<float>(speed));
+                if(speed == 1.0){
+                    stretch.flush();
+                    if(!drainStretch()){
+                        av_frame_unref(frame);
+                        break;
+                    }
+                }
+                stretch.setSpeed(speed);
+                curSpeed = speed;
+            }
 
-                uint8_t* audio_buf = (uint8_t*)av_malloc(buf_size);
-                int audio_buf_size = swr_convert(swrCtx_, &audio_buf, dst_nb_samples,
-                                             (const uint8_t**)frame->data, frame->nb_samples) * bytesPerSample;
-                audioPlayer_->enqueue(audio_buf,audio_buf_size);
-                av_free(audio_buf);
+            if(curSpeed != 1.0){
+                // 转换到临时缓冲，变速后再写入音频缓冲区
+                int dst_nb_samples = audioOutSamples(frame);
+                stretchIn.resize(static_cast<size_t>(dst_nb_samples) * bytesPerSample);
+                uint8_t* in = stretchIn.data();
+                int samples = convertAudio(frame,in,dst_nb_samples);
+                int skip = std::min(skipSamples,samples);
+                stretch.push(reinterpret_cast<const float*>(in + skip * bytesPerSample),samples - skip);
+
+                if(!drainStretch()){
+                    av_frame_unref(frame);
+                    break;
+                }
+            }else{
+                /*计算转换后的大小*/
+                int dst_nb_samples = audioOutSamples(frame);
+
+                // 转换结果直接写入音频缓冲区，不再经过临时缓冲
+                size_t want = static_cast<size_t>(dst_nb_samples) * bytesPerSample;
+                size_t granted = 0;
+                uint8_t* audio_buf = audioPlayer_->beginWrite(want,&granted);
+                if(!audio_buf){
+                    av_frame_unref(frame);
+                    break;
+                }
+                if(granted < want){
+                    // 一帧超过缓冲区可写入的上限（低采样率下的大帧），转换到临时缓冲后分段写入
+                    audioPlayer_->commitWrite(0);
+                    stretchIn.resize(want);
+                    int size = convertAudio(frame,stretchIn.data(),dst_nb_samples) * bytesPerSample;
+                    int skipBytes = std::min(skipSamples * bytesPerSample,size);
+                    if(!audioPlayer_->enqueue(stretchIn.data() + skipBytes,static_cast<size_t>(size - skipBytes))){
+                        av_frame_unref(frame);
+                        break;
+                    }
+                    continue;
+                }
+                int audio_buf_size = convertAudio(frame,audio_buf,dst_nb_samples) * bytesPerSample;
+                // 精确跳转时去掉开头的采样
+                int skipBytes = std::min(skipSamples * bytesPerSample,audio_buf_size);
+                if(skipBytes > 0)
+                    memmove(audio_buf,audio_buf + skipBytes,audio_buf_size - skipBytes);
+                audioPlayer_->commitWrite(audio_buf_size - skipBytes);
             }
         }
+        // 文件结束：解码器的剩余帧已送入变速处理器，再把处理器中不足一个分析帧的输入按当前倍速处理完
+        if(eof && curSpeed != 1.0 && running_){
+            stretch.finish();
+            drainStretch();
+        }
     }
     qDebug()<<"audio quit";
     av_frame_free(&frame);
@@ -472,122 +623,419 @@ void Player::videoThreadFunc()
 {
     AVFrame* frame = av_frame_alloc();
     AVRational vtb = fmtCtx_->streams[videoStreamIndex_]->time_base;
-    double totalTime = fmtCtx_->streams[videoStreamIndex_]->duration * av_q2d(vtb);
+    // 当前解码的包序列号，序列号变化说明发生了跳转
+    int serial = -1;
+    // 精确跳转时丢弃该时间点之前的帧
+    double dropBefore = -1.0;
+    // 自上次清空解码器后送入的包数，-1表示已输出过帧，用于统计解码延迟
+    int pendingPkts = 0;
+    AVRational frameRate = av_guess_frame_rate(fmtCtx_,videoStream_,nullptr);
+    // 没有原生着色器的格式转换为YUV420P，转换上下文在帧间复用
+    SwsContext* swsCtx = nullptr;
+    // 落后时的解码跳过级别，以及落后程度持续低于恢复阈值的帧数
+    DecodeSkipLevel skipLevel = DecodeSkipLevel::None;
+    int calmFrames = 0;
+    applySkipLevel(videoCtx_,skipLevel);
+    // 暂停时不挂起，解码到帧队列满为止，恢复播放时可立即显示
     while(running_){
-        while(paused_ && running_){
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        int pktSerial = 0;
+        AVPacket* pkt = videoPktQ_.pop(true,&pktSerial);
+        if(!pkt){
             continue;
         }
 
-        if(!running_){
-            break;
-        }
-
-
-        AVPacket* pkt = videoPktQ_.pop(true);
-        if(!pkt){
-            if(videoPktQ_.isStopped()  && isEof_){
-                // flush 解码器
-                avcodec_send_packet(videoCtx_, nullptr);
-                while (avcodec_receive_frame(videoCtx_, frame) == 0) {
-
-                    double pts = 0.0;
-                    if(frame->best_effort_timestamp != AV_NOPTS_VALUE)
-                        pts = frame->best_effort_timestamp * av_q2d(vtb);
-                    else if(frame->pts != AV_NOPTS_VALUE)
-                        pts = frame->pts * av_q2d(vtb);
-
-                    double diff = pts - audioPlayer_->getAudioClock();
-
-                    if(diff > 0)
-                        std::this_thread::sleep_for(std::chrono::duration<double>(diff));
-                    else if(diff < -0.1){
-                        continue;
-                        // 丢帧
-                    }
-
-                    if(frame->format == AV_PIX_FMT_YUV420P){
-                        // 发送进度信号
-                        emit playbackProgress(pts,totalTime);
-                        // 通知ui渲染
-                        std::shared_ptr<Yuv420PFrame> yuvFrame(std::make_shared<Yuv420PFrame>(frame));
-                        emit videoWidget_->setFrame(yuvFrame);
-                        av_frame_unref(frame);
-                    }
-                }
-                emit playFinish();
-                break;
-            }
-            continue;
+        if(pktSerial != serial){
+            // 丢弃解码器中缓存的旧帧
+            avcodec_flush_buffers(videoCtx_);
+            serial = pktSerial;
+            dropBefore = dropBefore_;
+            pendingPkts = 0;
+            // 跳转后从新位置正常解码
+            skipLevel = DecodeSkipLevel::None;
+            skipLevel_ = 0;
+            calmFrames = 0;
+            applySkipLevel(videoCtx_,skipLevel);
         }
 
+        // 空包表示文件结束，送入解码器后会输出剩余的帧
+        bool eof = pkt->data == nullptr && pkt->size == 0;
         int ret = avcodec_send_packet(videoCtx_,pkt);
         av_packet_free(&pkt);
         if(ret < 0)
             continue;
+        if(pendingPkts >= 0 && !eof)
+            ++pendingPkts;
+        // 解码延迟测量完成后，每送入一个包应输出一帧，没有输出说明该帧被跳过
+        int produced = 0;
+        DecodeSkipLevel sentLevel = skipLevel;
         while(ret >=0 && running_){
             ret = avcodec_receive_frame(videoCtx_,frame);
             if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
                 break;
             if(ret < 0) break;
 
+            if(pendingPkts > 0){
+                // 帧级多线程下解码器需要先填满各线程才开始输出
+                videoDecoderDelay_ = pendingPkts - 1;
+                qDebug() << "video decoder delay:" << pendingPkts - 1 << "frames"
+                         << (frameRate.num > 0 ? (pendingPkts - 1) * 1000.0 / av_q2d(frameRate) : 0.0) << "ms";
+                pendingPkts = -1;
+            }
+
             if (!running_) break;
             double pts = 0.0;
             if(frame->best_effort_timestamp != AV_NOPTS_VALUE)
                 pts = frame->best_effort_timestamp * av_q2d(vtb);
             else if(frame->pts != AV_NOPTS_VALUE)
                 pts = frame->pts * av_q2d(vtb);
+            ++produced;
+            ++skipDecoded_[static_cast<int>(sentLevel)];
+
+            // 与音频时钟比较，决定后续的包跳过多少解码工作
+            if(clockSerial_ == serial && !paused_ && dropBefore < 0){
+                // 倍速后的帧率明显超过刷新率时，多出的帧本来就显示不了，直接不解码非参考帧
+                DecodeSkipLevel floor = DecodeSkipLevel::None;
+                double shownFps = frameRate.num > 0 ? av_q2d(frameRate) * audioPlayer_->playbackSpeed() : 0.0;
+                if(shownFps * videoWidget_->presentScheduler()->refreshInterval() > 1.2)
+                    floor = DecodeSkipLevel::NonRef;
+                DecodeSkipLevel level = updateSkipLevel(skipLevel,audioPlayer_->getAudioClock() - pts,calmFrames,floor);
+                if(level != skipLevel){
+                    skipLevel = level;
+                    applySkipLevel(videoCtx_,skipLevel);
+                }
+            }
 
-            double diff = pts - audioPlayer_->getAudioClock();
+            double frameDur = frame->pkt_duration > 0 ? frame->pkt_duration * av_q2d(vtb) : 0.0;
+            // 精确跳转：目标之前的帧只解码不显示
+            if(dropBefore >= 0){
+                if(pts < dropBefore && pts + frameDur <= dropBefore){
+                    av_frame_unref(frame);
+                    continue;
+                }
+                dropBefore = -1.0;
+            }
 
-            if(diff > 0)
-                std::this_thread::sleep_for(std::chrono::duration<double>(diff));
-            else if(diff < -0.1){
+            if(!isNativePixelFormat(frame->format) && !convertFrame(&swsCtx,frame)){
+                av_frame_unref(frame);
                 continue;
-                // 丢帧
             }
 
-            if(frame->format == AV_PIX_FMT_YUV420P){
-                // 发送进度信号
-                emit playbackProgress(pts,totalTime);
-                // 通知ui渲染
-                std::shared_ptr<Yuv420PFrame> yuvFrame(std::make_shared<Yuv420PFrame>(frame));
-                emit videoWidget_->setFrame(yuvFrame);
-                // 释放frame
+            // 放入帧队列，队列满时在此等待显示线程取走
+            FrameQueue::Frame* vf = frameQ_.peekWritable();
+            if(!vf){
                 av_frame_unref(frame);
+                break;
+            }
+            av_frame_move_ref(vf->frame,frame);
+            vf->pts = pts;
+            vf->duration = frameDur;
+            vf->serial = serial;
+            vf->eof = false;
+            frameQ_.push();
+        }
+
+        if(produced == 0 && pendingPkts < 0 && !eof && sentLevel >= DecodeSkipLevel::NonRef)
+            ++skipSkipped_[static_cast<int>(sentLevel)];
+
+        // 解码器已冲刷完毕，放入结束标记，由显示线程在显示完剩余帧后通知
+        if(eof && running_){
+            FrameQueue::Frame* vf = frameQ_.peekWritable();
+            if(vf){
+                vf->serial = serial;
+                vf->eof = true;
+                frameQ_.push();
             }
         }
     }
-\
+
+    applySkipLevel(videoCtx_,DecodeSkipLevel::None);
     qDebug()<<"video quit";
+    sws_freeContext(swsCtx);
     av_frame_free(&frame);
 }
 
+bool Player::convertFrame(SwsContext **swsCtx, AVFrame *frame)
+{
+    // 格式或尺寸不变时sws_getCachedContext直接返回原上下文
+    *swsCtx = sws_getCachedContext(*swsCtx,frame->width,frame->height,static_cast<AVPixelFormat>(frame->format),
+                                   frame->width,frame->height,kFallbackPixelFormat,
+                                   SWS_BILINEAR,nullptr,nullptr,nullptr);
+    if(!*swsCtx)
+        return false;
+
+    AVFrame* out = av_frame_alloc();
+    out->format = kFallbackPixelFormat;
+    out->width = frame->width;
+    out->height = frame->height;
+    if(av_frame_get_buffer(out,0) < 0){
+        av_frame_free(&out);
+        return false;
+    }
+    sws_scale(*swsCtx,frame->data,frame->linesize,0,frame->height,out->data,out->linesize);
+    av_frame_copy_props(out,frame);
+    // sws把yuvj等全范围输入转换为有限范围输出，此时沿用源帧的范围标记会在着色器中再扩展一次
+    int* invTable = nullptr;
+    int* table = nullptr;
+    int srcRange = 0, dstRange = 0, brightness = 0, contrast = 0, saturation = 0;
+    if(sws_getColorspaceDetails(*swsCtx,&invTable,&srcRange,&table,&dstRange,&brightness,&contrast,&saturation) >= 0
+        && srcRange != dstRange)
+        out->color_range = dstRange ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+    av_frame_unref(frame);
+    av_frame_move_ref(frame,out);
+    av_frame_free(&out);
+    return true;
+}
+
+void Player::presentThreadFunc()
+{
+    AVRational vtb = fmtCtx_->streams[videoStreamIndex_]->time_base;
+    double totalTime = fmtCtx_->streams[videoStreamIndex_]->duration * av_q2d(vtb);
+    PresentScheduler* scheduler = videoWidget_->presentScheduler();
+    while(running_){
+        stateNotifier_.wait([this]{ return !running_ || !paused_; });
+        if(!running_)
+            break;
+
+        FrameQueue::Frame* vf = frameQ_.peekReadable(true);
+        if(!vf)
+            continue;
+
+        // 跳转前解码的帧直接丢弃
+        if(vf->serial != seekSerial_){
+            frameQ_.next();
+            continue;
+        }
+
+        if(vf->eof){
+            frameQ_.next();
+            // 当前位置的数据已全部播放完毕
+            if(running_)
+                emit playFinish();
+            continue;
+        }
+
+        // 调度器的视频时钟按正在播放的音频的倍速推进
+        scheduler->setRate(audioPlayer_->playbackSpeed());
+        // 等待到显示时间前的一小段，过晚或已被跳转作废则丢帧
+        if(waitForDisplay(vf->pts,vf->serial,scheduler->lead())){
+            // 发送进度信号
+            emit playbackProgress(vf->pts,totalTime);
+            // 交给调度器，由它在合适的vsync上屏
+            // 只增加引用计数，不拷贝像素
+            std::shared_ptr<VideoFrame> videoFrame(std::make_shared<VideoFrame>(vf->frame));
+            scheduler->submit(std::move(videoFrame),vf->pts,vf->serial);
+        }
+        frameQ_.next();
+    }
+    qDebug()<<"present quit";
+}
+
 
 
-void Player::openCodecs()
+void Player::openCodecs(const DecoderThreadingPolicy &threading)
 {
     AVCodec* ac = avcodec_find_decoder(fmtCtx_->streams[audioStreamIndex_]->codecpar->codec_id);
     audioCtx_ = avcodec_alloc_context3(ac);
     avcodec_parameters_to_context(audioCtx_,fmtCtx_->streams[audioStreamIndex_]->codecpar);
     avcodec_open2(audioCtx_,ac,nullptr);
 
-    swrCtx_ = swr_alloc_set_opts(nullptr,av_get_default_channel_layout(outChannels_),
-                                outFmt_,outRate_,
-                                av_get_default_channel_layout(audioCtx_->channels),
-                                audioCtx_->sample_fmt,audioCtx_->sample_rate,
-                                0,nullptr);
-    swr_init(swrCtx_);
     AVCodec* vc = avcodec_find_decoder(fmtCtx_->streams[videoStreamIndex_]->codecpar->codec_id);
     videoCtx_ = avcodec_alloc_context3(vc);
     avcodec_parameters_to_context(videoCtx_,fmtCtx_->streams[videoStreamIndex_]->codecpar);
+    applyDecoderThreading(videoCtx_,vc,threading);
+    // 解码器直接把图像写入渲染端的上传缓冲区
+    if(vc->capabilities & AV_CODEC_CAP_DR1){
+        videoCtx_->opaque = videoWidget_->bufferPool().get();
+        videoCtx_->get_buffer2 = &UploadBufferPool::getBuffer2;
+#if LIBAVCODEC_VERSION_MAJOR < 59
+        // 缓冲池是线程安全的，允许帧级多线程的工作线程直接调用
+        videoCtx_->thread_safe_callbacks = 1;
+#endif
+    }
     avcodec_open2(videoCtx_,vc,nullptr);
+    qDebug() << "video decoder" << vc->name << "threads:" << videoCtx_->thread_count
+             << "type:" << (videoCtx_->active_thread_type == FF_THREAD_FRAME ? "frame"
+                           : videoCtx_->active_thread_type == FF_THREAD_SLICE ? "slice" : "none");
     std::cout << "Audio stream codec ID: " << fmtCtx_->streams[audioStreamIndex_]->codecpar->codec_id << std::endl;
     std::cout << "Audio sample rate: " << fmtCtx_->streams[audioStreamIndex_]->codecpar->sample_rate << std::endl;
     std::cout << "Audio channels: " << fmtCtx_->streams[audioStreamIndex_]->codecpar->channels << std::endl;
 
 }
 
+void Player::applyDecoderThreading(AVCodecContext *ctx, const AVCodec *codec, const DecoderThreadingPolicy &policy)
+{
+    int count = policy.threadCount;
+    if(count <= 0){
+        // 保留一个核心给解复用、音频和界面线程
+        int cores = std::max(1,static_cast<int>(std::thread::hardware_concurrency()) - 1);
+        // 分辨率越高单帧解码越慢，需要的线程越多；小分辨率多开线程只会增加延迟
+        int64_t pixels = static_cast<int64_t>(ctx->width) * ctx->height;
+        int wanted;
+        if(pixels <= 1280 * 720)
+            wanted = 2;
+        else if(pixels <= 1920 * 1080)
+            wanted = 4;
+        else if(pixels <= 3840 * 2160)
+            wanted = 8;
+        else
+            wanted = 16;
+        count = std::min(cores,wanted);
+    }
+
+    DecoderThreading type = policy.type;
+    if(type == DecoderThreading::Auto && policy.lowLatency)
+        type = DecoderThreading::Slice;
+    // 解码器不支持所选方式时由FFmpeg回退为单线程
+    switch(type){
+    case DecoderThreading::Auto:
+        ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        break;
+    case DecoderThreading::Frame:
+        ctx->thread_type = FF_THREAD_FRAME;
+        break;
+    case DecoderThreading::Slice:
+        ctx->thread_type = FF_THREAD_SLICE;
+        if(!(codec->capabilities & AV_CODEC_CAP_SLICE_THREADS))
+            qDebug() << codec->name << "does not support slice threading, decoding single-threaded";
+        break;
+    case DecoderThreading::None:
+        count = 1;
+        break;
+    }
+    ctx->thread_count = count;
+}
+
+void Player::setDecoderThreading(const DecoderThreadingPolicy &policy)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    threadingPolicy_ = policy;
+}
+
+void Player::setIoMode(IoMode mode)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    ioMode_ = mode;
+}
+
+void Player::setPrefetchWindow(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    prefetchWindow_ = std::clamp<size_t>(bytes,2 << 20,256 << 20);
+}
+
+DemuxStats Player::demuxStats() const
+{
+    DemuxStats stats;
+    stats.mode = static_cast<IoMode>(activeIoMode_.load());
+    stats.packets = demuxPackets_;
+    stats.bytes = demuxBytes_;
+    stats.readSeconds = demuxReadNs_ * 1e-9;
+    return stats;
+}
+
+void Player::setTrackSelection(const TrackSelection &tracks)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    trackSelection_ = tracks;
+}
+
+TrackSelection Player::currentTracks() const
+{
+    TrackSelection tracks;
+    tracks.audio = audioStreamIndex_;
+    tracks.video = videoStreamIndex_;
+    return tracks;
+}
+
+int Player::selectStream(AVFormatContext *ctx, AVMediaType type, int wanted, int related)
+{
+    if(wanted >= 0){
+        if(wanted < static_cast<int>(ctx->nb_streams) && ctx->streams[wanted]->codecpar->codec_type == type)
+            return wanted;
+        std::cerr << "指定的流" << wanted << "不可用，改为自动选择" << std::endl;
+    }
+    // 按默认标记、解码器可用性、码率等排序选出最合适的流
+    int index = av_find_best_stream(ctx,type,-1,related,nullptr,0);
+    return index >= 0 ? index : -1;
+}
+
+int Player::videoDecoderDelay() const
+{
+    return videoDecoderDelay_;
+}
+
+DecodeSkipLevel Player::updateSkipLevel(DecodeSkipLevel current, double late, int& calmFrames,
+                                        DecodeSkipLevel floor)
+{
+    // 进入各级别的落后阈值（秒），落后超过阈值立即升级
+    static const double kEnter[] = {0.0, 0.04, 0.1, 0.3};
+    // 落后低于当前级别阈值的一半并持续这么多帧后降一级，避免在阈值附近来回切换
+    const int kCalmFrames = 12;
+
+    int level = static_cast<int>(current);
+    int wanted = 0;
+    for(int i = static_cast<int>(DecodeSkipLevel::Count) - 1; i > 0; --i){
+        if(late > kEnter[i]){
+            wanted = i;
+            break;
+        }
+    }
+
+    wanted = std::max(wanted,static_cast<int>(floor));
+    if(wanted > level){
+        calmFrames = 0;
+        level = wanted;
+    }else if(level > static_cast<int>(floor) && late < kEnter[level] / 2){
+        if(++calmFrames >= kCalmFrames){
+            calmFrames = 0;
+            --level;
+        }
+    }else{
+        calmFrames = 0;
+    }
+
+    if(level != static_cast<int>(current)){
+        skipLevel_ = level;
+        qDebug() << "video" << late * 1000 << "ms behind, decode skip level" << static_cast<int>(current) << "->" << level;
+    }
+    return static_cast<DecodeSkipLevel>(level);
+}
+
+void Player::applySkipLevel(AVCodecContext *ctx, DecodeSkipLevel level)
+{
+    AVDiscard loopFilter = AVDISCARD_DEFAULT;
+    AVDiscard frame = AVDISCARD_DEFAULT;
+    AVDiscard idct = AVDISCARD_DEFAULT;
+    switch(level){
+    case DecodeSkipLevel::Idct:
+        idct = AVDISCARD_NONKEY;
+        // fallthrough
+    case DecodeSkipLevel::NonRef:
+        loopFilter = AVDISCARD_ALL;
+        frame = AVDISCARD_NONREF;
+        break;
+    case DecodeSkipLevel::LoopFilter:
+        loopFilter = AVDISCARD_NONREF;
+        break;
+    default:
+        break;
+    }
+    ctx->skip_loop_filter = loopFilter;
+    ctx->skip_frame = frame;
+    ctx->skip_idct = idct;
+}
+
+DecodeSkipStats Player::decodeSkipStats() const
+{
+    DecodeSkipStats stats;
+    for(int i = 0; i < static_cast<int>(DecodeSkipLevel::Count); ++i){
+        stats.decoded[i] = skipDecoded_[i];
+        stats.skipped[i] = skipSkipped_[i];
+    }
+    stats.level = static_cast<DecodeSkipLevel>(skipLevel_.load());
+    return stats;
+}
+
 void Player::closeCodecs()
 {
     if(swrCtx_){
@@ -610,7 +1058,68 @@ void Player::openAudio()
 
     // 如果之前已经打开了音频设备，先关闭它
     closeAudio();
-    audioPlayer_ = std::make_unique<AudioPlayer>(44100,2);
+    // 以源的参数请求设备，输出参数以设备协商结果为准
+    audioPlayer_ = std::make_unique<AudioPlayer>(audioCtx_->sample_rate,audioCtx_->channels);
+    outRate_ = audioPlayer_->sampleRate();
+    outChannels_ = audioPlayer_->channels();
+
+    if(swrCtx_)
+        swr_free(&swrCtx_);
+    uint64_t inLayout = audioCtx_->channel_layout;
+    if(inLayout == 0 || av_get_channel_layout_nb_channels(inLayout) != audioCtx_->channels)
+        inLayout = av_get_default_channel_layout(audioCtx_->channels);
+    uint64_t outLayout = sdlChannelLayout(outChannels_);
+    // SDL的5.1后两个声道可以是侧置也可以是后置，按源的布局原样输出
+    if(outChannels_ == 6 && inLayout == AV_CH_LAYOUT_5POINT1_BACK)
+        outLayout = inLayout;
+
+    // 采样率、布局一致且解码输出已是float时不经过重采样器，直接拷贝或交错到音频缓冲区
+    bool sameFormat = audioCtx_->sample_fmt == AV_SAMPLE_FMT_FLT || audioCtx_->sample_fmt == AV_SAMPLE_FMT_FLTP;
+    if(sameFormat && audioCtx_->sample_rate == outRate_ && inLayout == outLayout){
+        qDebug() << "audio resampler bypassed";
+        return;
+    }
+    swrCtx_ = swr_alloc_set_opts(nullptr,outLayout,outFmt_,outRate_,
+                                inLayout,audioCtx_->sample_fmt,audioCtx_->sample_rate,
+                                0,nullptr);
+    swr_init(swrCtx_);
+}
+
+uint64_t Player::sdlChannelLayout(int channels)
+{
+    switch(channels){
+    case 1: return AV_CH_LAYOUT_MONO;
+    case 2: return AV_CH_LAYOUT_STEREO;
+    case 3: return AV_CH_LAYOUT_2POINT1;
+    case 4: return AV_CH_LAYOUT_QUAD;
+    case 5: return AV_CH_LAYOUT_5POINT0_BACK;
+    case 6: return AV_CH_LAYOUT_5POINT1;
+    case 7: return AV_CH_LAYOUT_6POINT1;
+    case 8: return AV_CH_LAYOUT_7POINT1;
+    default: return static_cast<uint64_t>(av_get_default_channel_layout(channels));
+    }
+}
+
+int Player::audioOutSamples(const AVFrame *frame) const
+{
+    if(!swrCtx_)
+        return frame->nb_samples;
+    return static_cast<int>(av_rescale_rnd(swr_get_delay(swrCtx_, frame->sample_rate) + frame->nb_samples,
+                                           outRate_, frame->sample_rate, AV_ROUND_UP));
+}
+
+int Player::convertAudio(const AVFrame *frame, uint8_t *dst, int dstSamples)
+{
+    if(swrCtx_)
+        return std::max(swr_convert(swrCtx_, &dst, dstSamples,
+                                    (const uint8_t**)frame->data, frame->nb_samples),0);
+    int n = std::min(frame->nb_samples,dstSamples);
+    if(av_sample_fmt_is_planar(static_cast<AVSampleFormat>(frame->format)))
+        AudioDsp::interleave(reinterpret_cast<const float* const*>(frame->extended_data),
+                             reinterpret_cast<float*>(dst),n,outChannels_);
+    else
+        memcpy(dst,frame->data[0],static_cast<size_t>(n) * outChannels_ * sizeof(float));
+    return n;
 }
 
 void Player::closeAudio()
@@ -624,10 +1133,159 @@ void Player::resetQueues()
 {
     audioPktQ_.clear();
     videoPktQ_.clear();
+    frameQ_.clear();
+}
+
+void Player::handleSeekRequest()
+{
+    seekReq_ = false;
+    double target = seekTarget_;
+    bool accurate = seekAccurate_;
+
+    int64_t ts = static_cast<int64_t>(target / av_q2d(videoStream_->time_base));
+    auto seekStart = std::chrono::steady_clock::now();
+
+    // 有完整的关键帧索引时直接按字节偏移定位到关键帧
+    bool viaIndex = false;
+    KeyframeIndex::Entry kf;
+    // 界面线程可能同时替换索引，取一份原子的副本，持有期间索引不会被释放
+    std::shared_ptr<KeyframeIndex> index = std::atomic_load(&keyframeIndex_);
+    if(index && index->lookup(ts,kf))
+        viaIndex = av_seek_frame(fmtCtx_,-1,kf.pos,AVSEEK_FLAG_BYTE) >= 0;
+
+    // 执行跳转（使用视频流作为参考）
+    if (!viaIndex && av_seek_frame(fmtCtx_,videoStreamIndex_ , ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        qDebug() << "Seek failed";
+        return;
+    }
+    double seekMs = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - seekStart).count();
+    qDebug() << "seek" << (viaIndex ? "via keyframe index" : "via av_seek_frame") << "took" << seekMs << "ms";
+
+    // 必须在切换序列号之前写入，解码线程看到新序列号时读取
+    dropBefore_ = accurate ? target : -1.0;
+
+    // 切换序列号，队列中已有的包作废，解码线程收到新序列号的包时冲刷解码器
+    int serial = seekSerial_ + 1;
+    audioPktQ_.flush(serial);
+    videoPktQ_.flush(serial);
+    seekSerial_ = serial;
+    // 丢弃调度器中尚未上屏的旧帧
+    videoWidget_->presentScheduler()->flush(serial);
+
+    // 丢弃已解码未播放的音频，同时解除音频线程在缓冲区上的阻塞
+    audioPlayer_->clearBuf();
+
+    isEof_ = false;
+    demuxThrottled_ = false;
+    // 唤醒等待旧帧显示时间的视频线程
+    stateNotifier_.notify();
+}
+
+bool Player::waitForDisplay(double pts, int serial, double lead)
+{
+    // 已停止或帧属于跳转前的位置
+    auto stale = [this,serial]{ return !running_ || serial != seekSerial_; };
+
+    // 跳转后音频时钟还没同步到新位置，先等音频线程更新时钟
+    // 超时（例如跳转点之后已没有音频）则不再等待
+    if(clockSerial_ != serial){
+        if(!stateNotifier_.waitFor(std::chrono::milliseconds(500),
+                                   [&]{ return stale() || clockSerial_ == serial; }))
+            clockSerial_ = serial;
+    }
+
+    while(!stale()){
+        double diff = pts - audioPlayer_->getAudioClock();
+        // 丢帧
+        if(diff < -0.1)
+            return false;
+        // diff为媒体时间，倍速播放时换算成实际等待时间
+        double speed = audioPlayer_->playbackSpeed();
+        diff = diff / speed - lead;
+        if(diff <= 0)
+            return true;
+        // 可被暂停/停止/跳转打断的等待，超时即到达显示时间
+        if(!stateNotifier_.waitFor(std::chrono::duration<double>(diff),
+                                   [&]{ return stale() || paused_; }))
+            return true;
+        // 被暂停打断：等恢复后按新的音频时钟重新计算
+        stateNotifier_.wait([&]{ return stale() || !paused_; });
+    }
+    return false;
 }
 
-void Player::flushDecoders()
+void Player::buildKeyframeIndex()
 {
-    if(audioCtx_) avcodec_flush_buffers(audioCtx_);
-    if(videoCtx_) avcodec_flush_buffers(videoCtx_);
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(!fmtCtx_ || videoStreamIndex_ < 0)
+        return;
+    startKeyframeIndex(true);
+}
+
+void Player::startKeyframeIndex(bool force)
+{
+    // 同一文件的索引已就绪或正在构建
+    if(keyframeIndex_ && indexUrl_ == url_
+        && (indexBuilding_ || keyframeIndex_->isComplete()))
+        return;
+
+    stopKeyframeIndex();
+    std::atomic_store(&keyframeIndex_,std::shared_ptr<KeyframeIndex>());
+    indexUrl_.clear();
+
+    const AVInputFormat* ifmt = fmtCtx_->iformat;
+    if(!ifmt || (ifmt->flags & AVFMT_NO_BYTE_SEEK))
+        return;
+    if(!force && !KeyframeIndex::isUsefulFor(ifmt->name))
+        return;
+
+    auto index = std::make_shared<KeyframeIndex>();
+    index->reset(url_,videoStreamIndex_);
+    std::atomic_store(&keyframeIndex_,index);
+    indexUrl_ = url_;
+    if(index->load()){
+        qDebug() << "keyframe index loaded from cache:" << index->size() << "keyframes";
+        return;
+    }
+
+    // 缓存不可用，后台扫描文件构建索引，完成后写入磁盘
+    indexCancel_ = false;
+    indexBuilding_ = true;
+    indexThread_ = std::thread([this,index]{
+        if(index->build(indexCancel_))
+            index->save();
+        indexBuilding_ = false;
+    });
+}
+
+void Player::stopKeyframeIndex()
+{
+    indexCancel_ = true;
+    if(indexThread_.joinable())
+        indexThread_.join();
+    indexBuilding_ = false;
+}
+
+uint64_t Player::wakeupCount() const
+{
+    return stateNotifier_.wakeups() + demuxNotifier_.wakeups()
+           + audioPktQ_.wakeups() + videoPktQ_.wakeups();
+}
+
+bool Player::demuxBufferFull()
+{
+    const DemuxBufferLimits& lim = demuxLimits_;
+    // 硬上限，保证内存占用可预期
+    if(audioPktQ_.bytes() + videoPktQ_.bytes() >= lim.maxTotalBytes)
+        return true;
+
+    bool hungry = audioPktQ_.isHungry(lim.audio) || videoPktQ_.isHungry(lim.video);
+    if(demuxThrottled_){
+        // 已暂停读包：等到有队列跌破低水位再恢复
+        demuxThrottled_ = !hungry;
+    }else{
+        bool full = audioPktQ_.isFull(lim.audio) || videoPktQ_.isFull(lim.video);
+        demuxThrottled_ = full && !hungry;
+    }
+    return demuxThrottled_;
 }
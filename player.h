@@ -5,12 +5,20 @@
 
 #include "videowidget.h"
 #include "audioplayer.h"
+#include "packetqueue.h"
+#include "keyframeindex.h"
+#include "framequeue.h"
+#include "pixelformat.h"
+#include "timestretch.h"
+#include "mappedfileio.h"
+#include "prefetchfileio.h"
 
 
 extern "C"{
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
 #include <libavutil/avutil.h>
 
 }
@@ -21,7 +29,6 @@ extern "C"{
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
-#include <queue>
 #include <memory>
 #include <QObject>
 
@@ -31,19 +38,79 @@ enum class MediaState{
     Stop
 };
 
-class PacketQueue{
-public:
-    void push(AVPacket* pkt);
-    AVPacket* pop(bool blocking = true);
-    void clear();
-    void setStop(bool s);
-    size_t size()const;
-    bool isStopped()const;
-private:
-    mutable std::mutex mtx_;
-    std::condition_variable cv_;
-    std::queue<AVPacket*> q_;
-    bool stop_{false};
+enum class SeekMode{
+    Fast,       // 跳到目标之前最近的关键帧，从关键帧开始播放
+    Accurate    // 从关键帧解码并丢弃目标之前的帧和音频采样，精确到目标时间
+};
+
+// 解复用背压参数
+// 任一队列达到高水位且没有队列处于饥饿状态时暂停读包，
+// 暂停后直到有队列跌破低水位才恢复；两个队列总字节数超过maxTotalBytes时无条件暂停
+struct DemuxBufferLimits{
+    QueueWatermarks audio{16 * 1024, 2 * 1024 * 1024, 300000, 3000000};
+    QueueWatermarks video{256 * 1024, 32 * 1024 * 1024, 300000, 3000000};
+    int64_t maxTotalBytes = 64 * 1024 * 1024;
+};
+
+// 视频解码线程模式
+enum class DecoderThreading{
+    Auto,   // 由解码器选择，支持帧级多线程时优先使用
+    Frame,  // 帧级多线程，吞吐量高但每个线程会增加一帧输出延迟
+    Slice,  // 片级多线程，不增加延迟，但依赖码流的slice/WPP划分
+    None    // 单线程
+};
+
+struct DecoderThreadingPolicy{
+    DecoderThreading type = DecoderThreading::Auto;
+    // 线程数，0表示按CPU核心数和分辨率自动选择
+    int threadCount = 0;
+    // 低延迟模式：Auto时改用片级多线程
+    bool lowLatency = false;
+};
+
+// 音视频轨道选择，值为流序号，-1表示由av_find_best_stream自动选择
+struct TrackSelection{
+    int audio = -1;
+    int video = -1;
+};
+
+// 解复用读取文件的方式
+enum class IoMode{
+    Default,    // FFmpeg默认的文件协议（read系统调用读入AVIO缓冲）
+    // 本地文件使用内存映射的AVIOContext，非本地文件或映射失败时回退到Default。
+    // 映射页读取失败（移动存储被拔出、网络文件系统出错）或播放中文件被截断时进程会收到SIGBUS，
+    // 默认协议在同样情况下只返回EIO，因此只在明确设置时使用
+    Mapped,
+    Prefetch    // 本地文件由后台I/O线程异步预读（io_uring或同步pread），非本地文件时回退到Default
+};
+
+// 解复用吞吐统计
+struct DemuxStats{
+    IoMode mode = IoMode::Default;
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    // 花在av_read_frame中的时间（秒）
+    double readSeconds = 0.0;
+    double packetsPerSecond() const { return readSeconds > 0 ? packets / readSeconds : 0.0; }
+    double megabytesPerSecond() const { return readSeconds > 0 ? bytes / readSeconds / (1 << 20) : 0.0; }
+};
+
+// 视频落后时的解码跳过级别，级别越高跳过的工作越多
+enum class DecodeSkipLevel{
+    None,       // 正常解码
+    LoopFilter, // 非参考帧跳过环路滤波
+    NonRef,     // 全部跳过环路滤波，并丢弃非参考帧
+    Idct,       // 在上一级基础上，除关键帧外跳过反变换
+    Count
+};
+
+// 各跳过级别的统计
+struct DecodeSkipStats{
+    // 在该级别下解码输出的帧数
+    uint64_t decoded[static_cast<int>(DecodeSkipLevel::Count)] = {};
+    // 在该级别下被解码器丢弃、没有输出的帧数
+    uint64_t skipped[static_cast<int>(DecodeSkipLevel::Count)] = {};
+    DecodeSkipLevel level = DecodeSkipLevel::None;
 };
 
 class Player : public QObject
@@ -60,14 +127,53 @@ public:
     void pause();
     // 停止
     void stop();
-    // 跳转
-    void seek(double pos);
+    // 跳转，pos为0~1的进度
+    void seek(double pos, SeekMode mode = SeekMode::Fast);
 
     // 设置音量
     void setVolume(float volume);
     // 获取音量
     float getVolume() const;
 
+    // 设置播放倍速（0.5~2.0），音频变速不变调，视频按音频时钟跟随
+    void setSpeed(double speed);
+    double speed() const;
+
+    // 设置解复用缓冲限制，下次开始播放时生效
+    void setDemuxBufferLimits(const DemuxBufferLimits& limits);
+
+    // 设置视频解码线程策略，下次打开文件时生效
+    void setDecoderThreading(const DecoderThreadingPolicy& policy);
+    // 视频解码器的输出延迟（帧），即从送入第一个包到输出第一帧之间多送入的包数
+    int videoDecoderDelay() const;
+
+    // 指定播放的音视频轨道，下次打开文件时生效；指定的流不存在或类型不符时自动选择
+    void setTrackSelection(const TrackSelection& tracks);
+    // 当前文件实际使用的轨道
+    TrackSelection currentTracks() const;
+
+    // 设置解复用的读取方式，下次打开文件时生效
+    void setIoMode(IoMode mode);
+    // 设置Prefetch方式的预读窗口（字节），下次打开文件时生效
+    void setPrefetchWindow(size_t bytes);
+    // 当前文件的解复用吞吐统计
+    DemuxStats demuxStats() const;
+
+    // 视频落后时解码跳过的统计
+    DecodeSkipStats decodeSkipStats() const;
+
+    // 设置已解码帧队列深度（即解码线程最多提前解码的帧数），下次开始播放时生效
+    void setFrameQueueDepth(int depth);
+    int frameQueueDepth() const;
+    // 已解码未显示的帧数
+    int frameQueueSize() const;
+
+    // 各线程从挂起状态被唤醒的累计次数，暂停时应保持不变
+    uint64_t wakeupCount() const;
+
+    // 为当前文件在后台构建关键帧索引，不论容器类型
+    void buildKeyframeIndex();
+
 
     MediaState getState()const;
 private:
@@ -78,14 +184,45 @@ private:
     void audioThreadFunc();
     // 视频解码线程
     void videoThreadFunc();
+    // 把frame原地转换为渲染端支持的格式，swsCtx在帧间复用
+    static bool convertFrame(SwsContext** swsCtx, AVFrame* frame);
+    // 显示线程，从帧队列中取帧并按音频时钟提前交给送显调度器
+    void presentThreadFunc();
     static void sdlAudioCallback(void* userdata,uint8_t* stream,int len);
 
-    void openCodecs();
+    // 选择type类型的流：wanted有效时直接使用，否则按av_find_best_stream的排序，
+    // related为相关联的流（音频参考所选的视频流所在节目），返回-1表示没有该类型的流
+    static int selectStream(AVFormatContext* ctx, AVMediaType type, int wanted, int related);
+    // threading为打开文件时在mtx_下取得的解码线程策略快照
+    void openCodecs(const DecoderThreadingPolicy& threading);
+    // 按策略配置视频解码器的线程数和线程类型，需在avcodec_open2之前调用
+    void applyDecoderThreading(AVCodecContext* ctx, const AVCodec* codec, const DecoderThreadingPolicy& policy);
+    // 根据解码出的帧落后音频时钟的时间（秒）调整跳过级别，落后越多跳过越多，追上后逐级恢复
+    // floor为倍速播放时的最低级别
+    DecodeSkipLevel updateSkipLevel(DecodeSkipLevel current, double late, int& calmFrames,
+                                    DecodeSkipLevel floor = DecodeSkipLevel::None);
+    // 把跳过级别设置到解码器上
+    static void applySkipLevel(AVCodecContext* ctx, DecodeSkipLevel level);
     void closeCodecs();
+    // 打开音频设备，并按设备协商出的参数决定是否需要重采样
     void openAudio();
     void closeAudio();
+    // SDL各声道数对应的声道顺序
+    static uint64_t sdlChannelLayout(int channels);
+    // 一帧解码数据转换后的最大采样数
+    int audioOutSamples(const AVFrame* frame) const;
+    // 把解码数据转换为设备参数下的交错float写入dst，返回采样数；无需重采样时直接拷贝或交错
+    int convertAudio(const AVFrame* frame, uint8_t* dst, int dstSamples);
     void resetQueues();
-    void flushDecoders();
+    // 在解复用线程中执行跳转：定位文件并切换包序列号
+    void handleSeekRequest();
+    // 载入或在后台构建当前文件的关键帧索引，force为false时只处理索引不完善的容器
+    void startKeyframeIndex(bool force);
+    void stopKeyframeIndex();
+    // 根据队列水位判断解复用线程是否应该暂停读包
+    bool demuxBufferFull();
+    // 等待到视频帧显示时间之前lead秒，返回false表示该帧应丢弃
+    bool waitForDisplay(double pts, int serial, double lead);
 
 private:
     std::string url_;
@@ -107,31 +244,82 @@ private:
     std::thread demuxThread_;
     std::thread audioThread_;
     std::thread videoThread_;
+    std::thread presentThread_;
 
     std::atomic<bool> running_{false};
     std::atomic<bool> paused_{false};
     std::atomic<bool> initCtx_{false};
 
+    // 暂停/继续/停止状态变化通知
+    WaitNotifier stateNotifier_;
+    // 包队列腾出空间通知，解复用线程在缓冲满时等待
+    WaitNotifier demuxNotifier_;
+
     PacketQueue audioPktQ_;
     PacketQueue videoPktQ_;
     std::unique_ptr<AudioPlayer> audioPlayer_;
 
     std::atomic<double> audioClock_{0.0};
 
+    // 源与设备参数一致时为空
     SwrContext* swrCtx_ = nullptr;
-    AVSampleFormat outFmt_ = AV_SAMPLE_FMT_S16;
+    AVSampleFormat outFmt_ = AV_SAMPLE_FMT_FLT;
+    // 由打开的音频设备决定
     int outRate_ = 44100;
     int outChannels_ = 2;
 
-    const size_t maxAudioPkts_ = 30;
-    const size_t maxVideoPkts_ = 30;
+    // 解码线程与显示线程之间的已解码帧队列
+    FrameQueue frameQ_;
+    int frameQueueDepth_ = 4;
+
+    DecoderThreadingPolicy threadingPolicy_;
+    TrackSelection trackSelection_;
+    std::atomic<int> videoDecoderDelay_{0};
+    // 解码跳过统计，下标为DecodeSkipLevel
+    std::atomic<uint64_t> skipDecoded_[static_cast<int>(DecodeSkipLevel::Count)] = {};
+    std::atomic<uint64_t> skipSkipped_[static_cast<int>(DecodeSkipLevel::Count)] = {};
+    std::atomic<int> skipLevel_{0};
+
+    IoMode ioMode_ = IoMode::Default;
+    size_t prefetchWindow_ = 16 << 20;
+    // 当前文件实际使用的读取方式，都为空时使用默认协议
+    std::unique_ptr<MappedFileIO> mappedIo_;
+    std::unique_ptr<PrefetchFileIO> prefetchIo_;
+    std::atomic<int> activeIoMode_{static_cast<int>(IoMode::Default)};
+    std::atomic<uint64_t> demuxPackets_{0};
+    std::atomic<uint64_t> demuxBytes_{0};
+    std::atomic<int64_t> demuxReadNs_{0};
+
+    DemuxBufferLimits bufferLimits_;
+    // 解复用线程使用的限制副本，以及当前是否处于暂停读包状态
+    DemuxBufferLimits demuxLimits_;
+    bool demuxThrottled_ = false;
 
     MediaState state_;
 
     // 是否读取到末尾了
     std::atomic<bool> isEof_ = false;
 
-    bool seekChangeClock_ = false;
+    // 跳转请求与目标位置（秒），由解复用线程处理
+    std::atomic<bool> seekReq_{false};
+    std::atomic<double> seekTarget_{0.0};
+    std::atomic<bool> seekAccurate_{false};
+    // 精确跳转时解码线程需要丢弃的时间点之前的数据（秒），快速跳转时为负
+    std::atomic<double> dropBefore_{-1.0};
+    // 当前的包序列号，每次跳转加一
+    std::atomic<int> seekSerial_{0};
+    // 音频时钟所对应的序列号
+    std::atomic<int> clockSerial_{-1};
+
+    // 关键帧索引及其后台构建线程
+    // 索引由界面线程替换、解复用线程读取，跨线程访问须经std::atomic_load/atomic_store
+    std::shared_ptr<KeyframeIndex> keyframeIndex_;
+    std::string indexUrl_;
+    std::thread indexThread_;
+    std::atomic<bool> indexCancel_{false};
+    std::atomic<bool> indexBuilding_{false};
+    // 播放倍速，由音频线程应用
+    std::atomic<double> speed_{1.0};
     // 音量大小
     float volume_ = 1.f;
 signals:
@@ -0,0 +1,520 @@
+#include "prefetchfileio.h"
+#include "mappedfileio.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <QDebug>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+
+#if defined(Q_OS_LINUX) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PREFETCH_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+#endif
+
+namespace {
+
+// 超过该时长的块读取视为一次磁盘卡顿
+constexpr int64_t kSlowReadNs = 10 * 1000 * 1000;
+constexpr int kIoBufferSize = 256 << 10;
+
+int64_t steadyNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+#ifdef PREFETCH_URING
+
+// 最小的io_uring封装：一个提交队列、一个完成队列，只支持READV
+// 只在I/O线程中使用
+class UringQueue
+{
+public:
+    ~UringQueue()
+    {
+        if(sqes_)
+            munmap(sqes_,sqesSize_);
+        if(cqRing_ && cqRing_ != sqRing_)
+            munmap(cqRing_,cqRingSize_);
+        if(sqRing_)
+            munmap(sqRing_,sqRingSize_);
+        // 关闭时内核会取消或等待未完成的请求
+        if(fd_ >= 0)
+            close(fd_);
+    }
+
+    // 内核不支持或被禁止时返回nullptr
+    static std::unique_ptr<UringQueue> create(unsigned entries)
+    {
+        std::unique_ptr<UringQueue> q(new UringQueue);
+        io_uring_params p;
+        memset(&p,0,sizeof(p));
+        q->fd_ = static_cast<int>(syscall(__NR_io_uring_setup,entries,&p));
+        if(q->fd_ < 0)
+            return nullptr;
+
+        q->sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        q->cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        // 新内核上两个环共用一次映射
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if(single)
+            q->sqRingSize_ = q->cqRingSize_ = std::max(q->sqRingSize_,q->cqRingSize_);
+        q->sqRing_ = mmap(nullptr,q->sqRingSize_,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,q->fd_,IORING_OFF_SQ_RING);
+        if(q->sqRing_ == MAP_FAILED){
+            q->sqRing_ = nullptr;
+            return nullptr;
+        }
+        if(single){
+            q->cqRing_ = q->sqRing_;
+        }else{
+            q->cqRing_ = mmap(nullptr,q->cqRingSize_,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,q->fd_,IORING_OFF_CQ_RING);
+            if(q->cqRing_ == MAP_FAILED){
+                q->cqRing_ = nullptr;
+                return nullptr;
+            }
+        }
+        q->sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr,q->sqesSize_,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,q->fd_,IORING_OFF_SQES);
+        if(sqes == MAP_FAILED)
+            return nullptr;
+        q->sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(q->sqRing_);
+        q->sqHead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        q->sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        q->sqMask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        q->sqEntries_ = p.sq_entries;
+        q->sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        char* cq = static_cast<char*>(q->cqRing_);
+        q->cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        q->cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        q->cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        q->cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        q->iovs_.resize(entries);
+        return q;
+    }
+
+    // 准备一个读请求，tag为完成时返回的标识（小于entries，兼作iovec下标）
+    bool prepRead(int fd, void* buf, unsigned len, int64_t offset, unsigned tag)
+    {
+        unsigned tail = *sqTail_;
+        if(tail - __atomic_load_n(sqHead_,__ATOMIC_ACQUIRE) >= sqEntries_ || tag >= iovs_.size())
+            return false;
+        iovs_[tag].iov_base = buf;
+        iovs_[tag].iov_len = len;
+        unsigned idx = tail & sqMask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        memset(sqe,0,sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&iovs_[tag]);
+        sqe->len = 1;
+        sqe->off = static_cast<uint64_t>(offset);
+        sqe->user_data = tag;
+        sqArray_[idx] = idx;
+        // 请求内容写好后再发布尾指针
+        __atomic_store_n(sqTail_,tail + 1,__ATOMIC_RELEASE);
+        ++pending_;
+        return true;
+    }
+
+    // 提交已准备的请求，并等待至少minComplete个完成；返回false表示io_uring不可再用
+    bool enter(unsigned minComplete)
+    {
+        while(true){
+            unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+            long ret = syscall(__NR_io_uring_enter,fd_,pending_,minComplete,flags,nullptr,0);
+            if(ret >= 0){
+                unsigned consumed = std::min<unsigned>(pending_,static_cast<unsigned>(ret));
+                pending_ -= consumed;
+                inKernel_ += consumed;
+                return true;
+            }
+            if(errno == EINTR)
+                continue;
+            // 完成队列满，先收割再提交
+            if(errno == EAGAIN || errno == EBUSY)
+                return true;
+            return false;
+        }
+    }
+
+    // 取出所有已完成的请求，f(tag,result)
+    template<typename F>
+    void reap(F f)
+    {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_,__ATOMIC_ACQUIRE);
+        for(; head != tail; ++head){
+            const io_uring_cqe& cqe = cqes_[head & cqMask_];
+            f(static_cast<unsigned>(cqe.user_data),cqe.res);
+            --inKernel_;
+        }
+        __atomic_store_n(cqHead_,head,__ATOMIC_RELEASE);
+    }
+
+    // io_uring_enter不可再用时，等内核已接收的请求全部完成并收割，之后才能复用或释放它们的缓冲
+    // 完成项由内核直接写入映射的完成队列，轮询即可，不需要系统调用；已准备但未提交的请求不会执行
+    template<typename F>
+    void drain(F f)
+    {
+        while(inKernel_ > 0){
+            reap(f);
+            if(inKernel_ > 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+private:
+    UringQueue() = default;
+
+    int fd_ = -1;
+    void* sqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    void* cqRing_ = nullptr;
+    size_t cqRingSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    // 已准备但还没交给内核的请求数
+    unsigned pending_ = 0;
+    // 内核已接收、还没收割的请求数
+    unsigned inKernel_ = 0;
+    std::vector<iovec> iovs_;
+};
+
+#else
+
+// 不支持io_uring的平台上只作为占位，始终走同步读取
+class UringQueue{};
+
+#endif
+
+PrefetchFileIO::~PrefetchFileIO()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    workCv_.notify_all();
+    readyCv_.notify_all();
+    if(ioThread_.joinable())
+        ioThread_.join();
+    // I/O线程已收割完所有请求，可以释放缓冲
+    uring_.reset();
+    if(avio_){
+        av_freep(&avio_->buffer);
+        avio_context_free(&avio_);
+    }
+    file_.close();
+}
+
+std::unique_ptr<PrefetchFileIO> PrefetchFileIO::open(const std::string &url, size_t window)
+{
+    std::string path;
+    if(!MappedFileIO::localPath(url,path))
+        return nullptr;
+
+    std::unique_ptr<PrefetchFileIO> io(new PrefetchFileIO);
+    io->file_.setFileName(QString::fromStdString(path));
+    if(!io->file_.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return nullptr;
+    io->size_ = io->file_.size();
+    if(io->size_ <= 0)
+        return nullptr;
+    io->blockCount_ = (io->size_ + io->blockSize_ - 1) / io->blockSize_;
+
+    // 窗口至少两块：当前块和前一块
+    size_t slotCount = std::max<size_t>(2,window / io->blockSize_);
+    io->buffer_.reset(new uint8_t[slotCount * io->blockSize_]);
+    io->slots_.resize(slotCount);
+    for(size_t i = 0; i < slotCount; ++i)
+        io->slots_[i].data = io->buffer_.get() + i * io->blockSize_;
+
+#ifdef PREFETCH_URING
+    io->uring_ = UringQueue::create(static_cast<unsigned>(slotCount));
+#endif
+    io->stats_.uring = io->uring_ != nullptr;
+
+    unsigned char* buffer = static_cast<unsigned char*>(av_malloc(kIoBufferSize));
+    if(!buffer)
+        return nullptr;
+    io->avio_ = avio_alloc_context(buffer,kIoBufferSize,0,io.get(),&PrefetchFileIO::readPacket,nullptr,&PrefetchFileIO::seek);
+    if(!io->avio_){
+        av_free(buffer);
+        return nullptr;
+    }
+    qDebug() << "prefetch io:" << (io->uring_ ? "io_uring" : "sync") << "window:" << slotCount << "x"
+             << (io->blockSize_ >> 20) << "MB";
+    io->ioThread_ = std::thread(&PrefetchFileIO::ioThreadFunc,io.get());
+    return io;
+}
+
+PrefetchFileIO::Stats PrefetchFileIO::stats() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return stats_;
+}
+
+int PrefetchFileIO::readPacket(void *opaque, uint8_t *buf, int size)
+{
+    auto* self = static_cast<PrefetchFileIO*>(opaque);
+    if(self->pos_ >= self->size_)
+        return AVERROR_EOF;
+    const int64_t n = static_cast<int64_t>(self->slots_.size());
+    int64_t block = self->pos_ / self->blockSize_;
+
+    std::unique_lock<std::mutex> lock(self->mtx_);
+    ++self->stats_.reads;
+    // 顺序前进时窗口跟着移动并保留前一块，容纳解析器的小幅回退；跳出窗口时整个窗口移过去
+    int64_t first = std::max<int64_t>(block - 1,0);
+    if(block < self->first_ || block >= self->first_ + n){
+        self->first_ = first;
+        self->depth_ = 2;
+        self->workCv_.notify_one();
+    }else if(first > self->first_){
+        self->first_ = first;
+        self->depth_ = std::min(self->depth_ * 2,n - 1);
+        self->workCv_.notify_one();
+    }
+
+    Slot& slot = self->slots_[block % n];
+    if(slot.block != block || slot.state != SlotState::Ready){
+        // 预读没跟上，只能等待
+        ++self->stats_.stalls;
+        self->waitingBlock_ = block;
+        int64_t t0 = steadyNow();
+        self->readyCv_.wait(lock,[&]{
+            return self->stop_ || (slot.block == block && slot.state == SlotState::Ready);
+        });
+        self->stats_.stallSeconds += (steadyNow() - t0) * 1e-9;
+        self->waitingBlock_ = -1;
+        if(self->stop_)
+            return AVERROR_EXIT;
+    }
+    if(slot.error)
+        return AVERROR(EIO);
+    int offset = static_cast<int>(self->pos_ - block * self->blockSize_);
+    int len = std::min(size,slot.len - offset);
+    // 窗口只由本线程移动，就绪的块在窗口内不会被I/O线程改写，可以在锁外拷贝
+    lock.unlock();
+    if(len <= 0)
+        return AVERROR_EOF;
+    memcpy(buf,slot.data + offset,len);
+    self->pos_ += len;
+    return len;
+}
+
+int64_t PrefetchFileIO::seek(void *opaque, int64_t offset, int whence)
+{
+    auto* self = static_cast<PrefetchFileIO*>(opaque);
+    int64_t pos;
+    switch(whence & ~AVSEEK_FORCE){
+    case AVSEEK_SIZE:
+        return self->size_;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = self->pos_ + offset;
+        break;
+    case SEEK_END:
+        pos = self->size_ + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if(pos < 0)
+        return AVERROR(EINVAL);
+    // 只移动读位置，窗口在下次读取时再跟过去
+    self->pos_ = pos;
+    std::lock_guard<std::mutex> lock(self->mtx_);
+    ++self->stats_.seeks;
+    return pos;
+}
+
+int PrefetchFileIO::blockLength(int64_t block) const
+{
+    return static_cast<int>(std::min<int64_t>(blockSize_,size_ - block * blockSize_));
+}
+
+int PrefetchFileIO::readBlock(Slot &slot, int offset)
+{
+    int len = blockLength(slot.block);
+    int64_t base = slot.block * blockSize_;
+    while(offset < len){
+#if defined(Q_OS_UNIX)
+        ssize_t n = pread(file_.handle(),slot.data + offset,len - offset,base + offset);
+#else
+        // 只有I/O线程访问file_，seek+read等同于pread
+        qint64 n = file_.seek(base + offset) ? file_.read(reinterpret_cast<char*>(slot.data + offset),len - offset) : -1;
+#endif
+        if(n < 0)
+            return -1;
+        if(n == 0)
+            break;
+        offset += static_cast<int>(n);
+    }
+    return offset;
+}
+
+void PrefetchFileIO::complete(Slot &slot, int result)
+{
+    --inFlight_;
+    int64_t latency = steadyNow() - slot.submitNs;
+    int64_t us = latency / 1000;
+    int bucket = 0;
+    while(bucket < kLatencyBuckets - 1 && us >= (kLatencyBase << bucket))
+        ++bucket;
+    ++stats_.latency[bucket];
+    ++stats_.blocks;
+
+    const int64_t n = static_cast<int64_t>(slots_.size());
+    bool inWindow = slot.block >= first_ && slot.block < first_ + n;
+    slot.error = result < 0;
+    slot.len = std::max(result,0);
+    stats_.bytes += slot.len;
+    // 读取期间窗口已经移走（跳转）的块直接作废
+    slot.state = inWindow ? SlotState::Ready : SlotState::Empty;
+
+    if(latency >= kSlowReadNs){
+        ++stats_.slowReads;
+        // 完成时解复用线程并没有在等它，说明这次卡顿被预读窗口吸收了
+        if(inWindow && slot.block != waitingBlock_)
+            ++stats_.stallsAvoided;
+    }
+}
+
+void PrefetchFileIO::ioThreadFunc()
+{
+    const int64_t n = static_cast<int64_t>(slots_.size());
+    std::vector<int> submit;
+    submit.reserve(n);
+    std::vector<std::pair<int,int>> done;
+    done.reserve(n);
+    // 本轮已加入done的块，避免同一块完成两次
+    std::vector<char> queued(n);
+
+    std::unique_lock<std::mutex> lock(mtx_);
+    while(!stop_){
+        // 从窗口开头起找出既没有读好也不在读取中的块，越靠前越先提交
+        submit.clear();
+        int64_t end = std::min({first_ + n,first_ + 1 + depth_,blockCount_});
+        for(int64_t b = first_; b < end; ++b){
+            int idx = static_cast<int>(b % n);
+            Slot& slot = slots_[idx];
+            if(slot.state == SlotState::InFlight || (slot.block == b && slot.state == SlotState::Ready))
+                continue;
+            slot.block = b;
+            slot.state = SlotState::InFlight;
+            slot.error = false;
+            slot.submitNs = steadyNow();
+            submit.push_back(idx);
+            // 同步读取时一次只取一块，窗口移动能尽快生效
+            if(!uring_)
+                break;
+        }
+        if(submit.empty() && inFlight_ == 0){
+            workCv_.wait(lock);
+            continue;
+        }
+        inFlight_ += static_cast<int>(submit.size());
+        lock.unlock();
+
+        // 以下只访问处于读取中的块，解复用线程不会修改它们
+        done.clear();
+#ifdef PREFETCH_URING
+        if(uring_){
+            auto onComplete = [&](unsigned idx, int res){
+                Slot& slot = slots_[idx];
+                // 失败或读到一半（很少见）时同步补齐
+                if(res < 0)
+                    res = readBlock(slot,0);
+                else if(res < blockLength(slot.block))
+                    res = readBlock(slot,res);
+                done.emplace_back(static_cast<int>(idx),res);
+            };
+            for(int idx : submit){
+                Slot& slot = slots_[idx];
+                // 提交队列不小于块数，正常不会满；万一满了就同步读取，不能让块一直处于读取中
+                if(!uring_->prepRead(file_.handle(),slot.data,blockLength(slot.block),
+                                     slot.block * blockSize_,static_cast<unsigned>(idx)))
+                    done.emplace_back(idx,readBlock(slot,0));
+            }
+            if(uring_->enter(1)){
+                uring_->reap(onComplete);
+            }else{
+                qWarning() << "io_uring_enter failed, falling back to synchronous reads";
+                // 内核已接收的请求仍会写入块缓冲，先等它们完成（结果照常使用）再关闭io_uring
+                uring_->drain(onComplete);
+                uring_.reset();
+                // 其余读取中的块（之前各轮提交的、已准备未提交的）改为同步读取，已完成的不再重复
+                std::fill(queued.begin(),queued.end(),0);
+                for(const auto& d : done)
+                    queued[d.first] = 1;
+                std::vector<int> rest;
+                {
+                    std::lock_guard<std::mutex> guard(mtx_);
+                    stats_.uring = false;
+                    for(int idx = 0; idx < static_cast<int>(n); ++idx){
+                        if(slots_[idx].state == SlotState::InFlight && !queued[idx])
+                            rest.push_back(idx);
+                    }
+                }
+                for(int idx : rest)
+                    done.emplace_back(idx,readBlock(slots_[idx],0));
+            }
+        }
+#endif
+        if(!uring_ && done.empty()){
+            for(int idx : submit)
+                done.emplace_back(idx,readBlock(slots_[idx],0));
+        }
+
+        lock.lock();
+        for(const auto& d : done)
+            complete(slots_[d.first],d.second);
+        if(!done.empty())
+            readyCv_.notify_all();
+    }
+
+#ifdef PREFETCH_URING
+    // 等待已提交的请求全部完成后再释放缓冲
+    if(uring_){
+        while(inFlight_ > 0){
+            lock.unlock();
+            bool ok = uring_->enter(1);
+            int reaped = 0;
+            if(ok)
+                uring_->reap([&](unsigned, int){ ++reaped; });
+            else
+                uring_->drain([&](unsigned, int){ ++reaped; });
+            lock.lock();
+            inFlight_ -= reaped;
+            // 无法再提交时只剩从未交给内核的请求，它们不会写入缓冲
+            if(!ok)
+                break;
+        }
+    }
+#endif
+}
@@ -0,0 +1,117 @@
+#ifndef PREFETCHFILEIO_H
+#define PREFETCHFILEIO_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <QFile>
+
+extern "C"{
+#include <libavformat/avformat.h>
+}
+
+class UringQueue;
+
+// 带异步预读的本地文件AVIOContext
+// 文件按固定大小分块，独立的I/O线程让读位置之后一个窗口内的块始终处于读取中或已读好，
+// 解复用线程读取时多数情况下只需memcpy，磁盘或网络挂载的偶发卡顿被窗口吸收。
+// Linux上用io_uring同时提交整个窗口的读请求（直接使用系统调用，不依赖liburing），
+// io_uring不可用时（旧内核、被seccomp禁止、其他平台）退回I/O线程中逐块同步读取。
+// 读写回调只在解复用线程中调用。
+class PrefetchFileIO
+{
+public:
+    // 读取延迟直方图：第i格为[kLatencyBase<<(i-1), kLatencyBase<<i)微秒，第0格为不足kLatencyBase
+    static constexpr int kLatencyBuckets = 16;
+    static constexpr int64_t kLatencyBase = 16;
+
+    struct Stats{
+        bool uring = false;
+        // 解复用线程的读取次数，以及其中需要等待数据的次数和累计等待时间
+        uint64_t reads = 0;
+        uint64_t stalls = 0;
+        double stallSeconds = 0.0;
+        uint64_t seeks = 0;
+        // 完成的块读取
+        uint64_t blocks = 0;
+        uint64_t bytes = 0;
+        // 慢读取（超过kSlowRead），以及其中完成时解复用线程并未在等待、即被预读吸收的次数
+        uint64_t slowReads = 0;
+        uint64_t stallsAvoided = 0;
+        std::array<uint64_t,kLatencyBuckets> latency{};
+    };
+
+    ~PrefetchFileIO();
+    PrefetchFileIO(const PrefetchFileIO&) = delete;
+    PrefetchFileIO& operator=(const PrefetchFileIO&) = delete;
+
+    // url为本地路径（或file:前缀）时打开文件并启动I/O线程，window为预读窗口字节数
+    // 不是本地文件或打开失败时返回nullptr
+    static std::unique_ptr<PrefetchFileIO> open(const std::string& url, size_t window);
+
+    AVIOContext* context() const { return avio_; }
+    int64_t size() const { return size_; }
+    Stats stats() const;
+
+private:
+    enum class SlotState{
+        Empty,
+        InFlight,
+        Ready
+    };
+
+    struct Slot{
+        int64_t block = -1;
+        SlotState state = SlotState::Empty;
+        uint8_t* data = nullptr;
+        int len = 0;
+        bool error = false;
+        int64_t submitNs = 0;
+    };
+
+    PrefetchFileIO() = default;
+
+    static int readPacket(void* opaque, uint8_t* buf, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+    void ioThreadFunc();
+    // 同步读取一块，只在I/O线程中调用，返回读到的字节数，失败返回-1
+    int readBlock(Slot& slot, int offset);
+    // 块读取完成，需持有锁调用
+    void complete(Slot& slot, int result);
+    int blockLength(int64_t block) const;
+
+    QFile file_;
+    int64_t size_ = 0;
+    int64_t pos_ = 0;
+    int blockSize_ = 1 << 20;
+    int64_t blockCount_ = 0;
+
+    mutable std::mutex mtx_;
+    // 块读好时唤醒解复用线程
+    std::condition_variable readyCv_;
+    // 窗口移动时唤醒I/O线程
+    std::condition_variable workCv_;
+    // 窗口的第一块，只由解复用线程修改
+    int64_t first_ = 0;
+    // 当前块之后保持读取的块数：跳转后从2开始，顺序前进时翻倍直到整个窗口，
+    // 避免随机访问时每次跳转都读满整个窗口
+    int64_t depth_ = 2;
+    // 解复用线程正在等待的块
+    int64_t waitingBlock_ = -1;
+    int inFlight_ = 0;
+    bool stop_ = false;
+    std::vector<Slot> slots_;
+    std::unique_ptr<uint8_t[]> buffer_;
+    std::unique_ptr<UringQueue> uring_;
+    std::thread ioThread_;
+
+    AVIOContext* avio_ = nullptr;
+    Stats stats_;
+};
+
+#endif // PREFETCHFILEIO_H
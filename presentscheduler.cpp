@@ -0,0 +1,194 @@
+#include "presentscheduler.h"
+#include <QOpenGLWidget>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QDebug>
+#include <chrono>
+#include <cmath>
+
+namespace {
+double nowSeconds()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+}
+
+PresentScheduler::PresentScheduler(QOpenGLWidget *widget)
+    :QObject(widget)
+    ,widget_(widget)
+{
+    // 以屏幕标称刷新率作为初值，之后按实际交换间隔修正
+    QScreen* screen = QGuiApplication::primaryScreen();
+    if(screen && screen->refreshRate() > 1.0)
+        interval_ = 1.0 / screen->refreshRate();
+    connect(widget_,&QOpenGLWidget::frameSwapped,this,&PresentScheduler::onFrameSwapped);
+}
+
+void PresentScheduler::setClock(Clock clock)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    clock_ = std::move(clock);
+    locked_ = false;
+}
+
+void PresentScheduler::setRate(double rate)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    rate_ = rate > 0.0 ? rate : 1.0;
+}
+
+void PresentScheduler::setPaused(bool paused)
+{
+    bool restart = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        paused_ = paused;
+        locked_ = false;
+        restart = !paused && !ticking_ && !pending_.empty();
+        if(restart)
+            ticking_ = true;
+    }
+    if(restart)
+        QMetaObject::invokeMethod(this,"kick",Qt::QueuedConnection);
+}
+
+void PresentScheduler::submit(std::shared_ptr<VideoFrame> frame, double pts, int serial)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(serial_ >= 0 && serial != serial_)
+            return;
+        pending_.push_back(Pending{std::move(frame),pts});
+        while(pending_.size() > kMaxPending){
+            pending_.pop_front();
+            ++dropped_;
+        }
+        if(ticking_ || paused_)
+            return;
+        ticking_ = true;
+    }
+    // 空闲时由一次重绘重新启动vsync节奏
+    QMetaObject::invokeMethod(this,"kick",Qt::QueuedConnection);
+}
+
+void PresentScheduler::flush(int serial)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    pending_.clear();
+    if(serial >= 0)
+        serial_ = serial;
+    locked_ = false;
+}
+
+double PresentScheduler::lead() const
+{
+    // 提前两个刷新间隔，保证下一次vsync时候选帧已经到达
+    return 2.0 * interval_;
+}
+
+double PresentScheduler::refreshInterval() const
+{
+    return interval_;
+}
+
+PresentScheduler::Stats PresentScheduler::stats() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    Stats s;
+    s.refreshInterval = interval_;
+    s.swapJitter = swapCount_ ? swapJitterSum_ / swapCount_ : 0.0;
+    if(presented_){
+        s.presentError = errorSum_ / presented_;
+        s.presentJitter = std::sqrt(std::max(0.0, errorSqSum_ / presented_ - s.presentError * s.presentError));
+    }
+    s.presented = presented_;
+    s.dropped = dropped_;
+    s.repeats = repeats_;
+    return s;
+}
+
+void PresentScheduler::kick()
+{
+    widget_->update();
+}
+
+void PresentScheduler::onFrameSwapped()
+{
+    double now = nowSeconds();
+    double interval = interval_;
+    // 连续的两次交换之间相差一个刷新间隔，间隔过长说明中间空闲过，不参与估计
+    double d = now - lastSwap_;
+    bool continuous = lastSwap_ >= 0.0 && d < 2.5 * interval;
+    if(continuous){
+        // 只用接近一个刷新间隔的样本更新估计，错过vsync的样本只计入抖动
+        if(d > 0.5 * interval && d < 1.5 * interval)
+            interval += (d - interval) * 0.05;
+        interval_ = interval;
+    }
+    lastSwap_ = now;
+
+    std::shared_ptr<VideoFrame> frame;
+    bool report = false;
+    bool more = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(continuous){
+            swapJitterSum_ += std::fabs(d - interval);
+            ++swapCount_;
+        }
+        if(paused_ || !clock_ || pending_.empty()){
+            ticking_ = false;
+            return;
+        }
+
+        // 下一次vsync上屏时音频时钟的值
+        double target = clock_() + interval * rate_;
+        // 视频时钟每次vsync前进一个刷新间隔并缓慢向音频时钟靠拢，
+        // 音频时钟按回调分块阶跃更新，直接使用会让帧在相邻两次vsync之间来回跳动
+        if(!locked_ || !continuous || std::fabs(target - vclock_ - interval * rate_) > 0.1){
+            vclock_ = target;
+            locked_ = true;
+        }else{
+            vclock_ += interval * rate_;
+            vclock_ += (target - vclock_) * 0.05;
+        }
+
+        // 选择显示区间覆盖本次vsync的帧：pts不晚于vclock_加半个刷新间隔的最后一帧
+        size_t chosen = pending_.size();
+        for(size_t i = 0; i < pending_.size(); ++i){
+            if(pending_[i].pts > vclock_ + 0.5 * interval * rate_)
+                break;
+            chosen = i;
+        }
+        if(chosen == pending_.size()){
+            // 还没到下一帧的时间，本次vsync继续显示当前帧
+            if(hasCurrent_)
+                ++repeats_;
+        }else{
+            dropped_ += chosen;
+            double error = vclock_ - pending_[chosen].pts;
+            errorSum_ += error;
+            errorSqSum_ += error * error;
+            ++presented_;
+            report = presented_ % 600 == 0;
+            frame = std::move(pending_[chosen].frame);
+            pending_.erase(pending_.begin(),pending_.begin() + chosen + 1);
+            hasCurrent_ = true;
+        }
+        ticking_ = more = !pending_.empty();
+    }
+
+    if(frame)
+        emit present(std::move(frame));
+    // 还有帧等待显示时保持每个vsync重绘一次，重绘时不会重复上传纹理
+    else if(more)
+        widget_->update();
+
+    if(report){
+        Stats s = stats();
+        qDebug() << "present: refresh" << s.refreshInterval * 1000 << "ms, swap jitter" << s.swapJitter * 1000
+                 << "ms, error" << s.presentError * 1000 << "+/-" << s.presentJitter * 1000
+                 << "ms, presented" << s.presented << "dropped" << s.dropped << "repeats" << s.repeats;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef PRESENTSCHEDULER_H
+#define PRESENTSCHEDULER_H
+
+#include <QObject>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "videoframe.h"
+
+class QOpenGLWidget;
+
+// 按显示器刷新节奏送显的调度器
+// 显示线程提前把帧交给调度器，调度器在GUI线程中跟随frameSwapped（即每次vsync）运行：
+// 估计刷新间隔，推算下一次vsync上屏时的播放时间，选出该时刻应该显示的帧。
+// 24/25/30fps的视频在60Hz显示器上因此得到固定的2:3、2:2等节奏，而不是取决于事件循环何时重绘。
+//
+// submit/flush/setClock/setPaused可在任意线程调用，其余在GUI线程中运行。
+class PresentScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    // 送显统计，时间单位为秒
+    struct Stats{
+        double refreshInterval = 0.0;   // 估计的刷新间隔
+        double swapJitter = 0.0;        // 相邻两次交换的间隔偏离刷新间隔的平均值
+        double presentError = 0.0;      // 帧上屏时间相对其pts的平均偏差
+        double presentJitter = 0.0;     // 上述偏差的标准差
+        uint64_t presented = 0;         // 显示的帧数
+        uint64_t dropped = 0;           // 未能赶上任何一次vsync而丢弃的帧数
+        uint64_t repeats = 0;           // 沿用上一帧的vsync次数
+    };
+    // 返回当前播放时间（秒）
+    using Clock = std::function<double()>;
+
+    explicit PresentScheduler(QOpenGLWidget* widget);
+
+    // 设置播放时钟，传空表示停止送显
+    void setClock(Clock clock);
+    // 时钟速率，倍速播放时大于1
+    void setRate(double rate);
+    void setPaused(bool paused);
+    // 提交一帧，序列号与最近一次flush不同的帧直接丢弃
+    void submit(std::shared_ptr<VideoFrame> frame, double pts, int serial);
+    // 丢弃未显示的帧，serial不小于0时此后只接受该序列号的帧
+    void flush(int serial = -1);
+    // 帧应提前多久提交
+    double lead() const;
+    // 估计的显示器刷新间隔（秒）
+    double refreshInterval() const;
+
+    Stats stats() const;
+
+signals:
+    // 选中的帧，连接到VideoWidget
+    void present(std::shared_ptr<VideoFrame> frame);
+
+private slots:
+    void onFrameSwapped();
+    void kick();
+
+private:
+    struct Pending{
+        std::shared_ptr<VideoFrame> frame;
+        double pts;
+    };
+    // 未显示的帧数上限，窗口不可见时frameSwapped停止，超出的旧帧直接丢弃
+    static constexpr size_t kMaxPending = 8;
+
+    QOpenGLWidget* widget_ = nullptr;
+
+    mutable std::mutex mtx_;
+    std::deque<Pending> pending_;
+    Clock clock_;
+    double rate_ = 1.0;
+    bool paused_ = false;
+    int serial_ = -1;
+    // 是否有重绘在进行，没有时submit需要重新启动
+    bool ticking_ = false;
+
+    // 平滑后的视频时钟：下一次vsync上屏时的播放时间，locked_为false时重新对齐到音频时钟
+    double vclock_ = 0.0;
+    bool locked_ = false;
+    // 是否已显示过帧，用于统计沿用上一帧的次数
+    bool hasCurrent_ = false;
+
+    // 上一次交换的时间，只在GUI线程访问
+    double lastSwap_ = -1.0;
+
+    std::atomic<double> interval_{1.0 / 60.0};
+
+    // 统计累加量，受mtx_保护
+    double swapJitterSum_ = 0.0;
+    uint64_t swapCount_ = 0;
+    double errorSum_ = 0.0;
+    double errorSqSum_ = 0.0;
+    uint64_t presented_ = 0;
+    uint64_t dropped_ = 0;
+    uint64_t repeats_ = 0;
+};
+
+#endif // PRESENTSCHEDULER_H
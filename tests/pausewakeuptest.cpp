@@ -0,0 +1,120 @@
+// 暂停时流水线线程的唤醒次数测试
+// 按Player中的等待方式模拟三类线程：音频线程在状态通知上等待恢复；
+// 视频线程在可被暂停打断的定时等待（waitForDisplay）中被打断后等待恢复；
+// 解码线程阻塞在空的包队列上（暂停后解复用不再入队）。
+// 暂停期间所有线程的累计唤醒次数应保持不变，恢复和停止后应立即响应。
+#include "waitnotifier.h"
+#include "packetqueue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+extern "C"{
+#include <libavcodec/avcodec.h>
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 统计暂停状态的时长
+constexpr auto kPauseWindow = std::chrono::seconds(1);
+// 暂停后等线程进入等待的时间
+constexpr auto kSettle = std::chrono::milliseconds(50);
+// 允许的空闲唤醒频率，只为容忍条件变量的虚假唤醒；改为轮询时会达到每秒上百次
+constexpr double kMaxIdleWakeupsPerSecond = 2.0;
+constexpr auto kMaxLatency = std::chrono::milliseconds(100);
+
+int failures = 0;
+
+void check(bool ok, const char* what)
+{
+    std::printf("%s: %s\n",ok ? "PASS" : "FAIL",what);
+    if(!ok)
+        ++failures;
+}
+
+double millisecondsSince(Clock::time_point t)
+{
+    return std::chrono::duration<double,std::milli>(Clock::now() - t).count();
+}
+
+}
+
+int main()
+{
+    WaitNotifier state;
+    PacketQueue queue(64);
+    std::atomic<bool> running{true};
+    std::atomic<bool> paused{false};
+    // 音频线程每次从等待中恢复时递增
+    std::atomic<int> audioPasses{0};
+
+    std::thread audio([&]{
+        while(running){
+            state.wait([&]{ return !running || !paused; });
+            if(!running)
+                break;
+            ++audioPasses;
+            // 播放中：模拟等待音频缓冲区腾出空间
+            state.waitFor(std::chrono::milliseconds(2),[&]{ return !running || paused; });
+        }
+    });
+    std::thread video([&]{
+        while(running){
+            // 等到显示时间或被暂停打断
+            if(!state.waitFor(std::chrono::milliseconds(20),[&]{ return !running || paused; }))
+                continue;
+            state.wait([&]{ return !running || !paused; });
+        }
+    });
+    std::thread decoder([&]{
+        while(AVPacket* pkt = queue.pop(true))
+            av_packet_free(&pkt);
+    });
+
+    auto wakeups = [&]{ return state.wakeups() + queue.wakeups(); };
+
+    // 播放一段时间后暂停
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    paused = true;
+    state.notify();
+    std::this_thread::sleep_for(kSettle);
+
+    uint64_t before = wakeups();
+    int passesBefore = audioPasses;
+    std::this_thread::sleep_for(kPauseWindow);
+    uint64_t idle = wakeups() - before;
+    double rate = idle / std::chrono::duration<double>(kPauseWindow).count();
+    std::printf("wakeups while paused: %llu (%.2f/s)\n",static_cast<unsigned long long>(idle),rate);
+    check(rate <= kMaxIdleWakeupsPerSecond,"paused threads stay asleep");
+    check(audioPasses == passesBefore,"audio thread does not run while paused");
+
+    // 恢复后音频线程应立即继续
+    auto resumeAt = Clock::now();
+    paused = false;
+    state.notify();
+    while(audioPasses == passesBefore && millisecondsSince(resumeAt) < 1000)
+        std::this_thread::yield();
+    double resumeMs = millisecondsSince(resumeAt);
+    std::printf("resume latency: %.3f ms\n",resumeMs);
+    check(resumeMs < std::chrono::duration<double,std::milli>(kMaxLatency).count(),"resume wakes the audio thread promptly");
+
+    // 停止时所有线程应立即退出
+    paused = true;
+    state.notify();
+    std::this_thread::sleep_for(kSettle);
+    auto stopAt = Clock::now();
+    running = false;
+    state.notify();
+    queue.setStop(true);
+    audio.join();
+    video.join();
+    decoder.join();
+    double stopMs = millisecondsSince(stopAt);
+    std::printf("stop latency: %.3f ms\n",stopMs);
+    check(stopMs < std::chrono::duration<double,std::milli>(kMaxLatency).count(),"stop wakes all threads promptly");
+
+    return failures == 0 ? 0 : 1;
+}
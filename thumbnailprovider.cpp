@@ -0,0 +1,397 @@
+#include "thumbnailprovider.h"
+#include <QThread>
+#include <QPainter>
+#include <QBuffer>
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+extern "C"{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+const quint32 kAtlasMagic = 0x54484231; // "THB1"
+// 缩略图宽度，高度按视频宽高比计算
+const int kTileWidth = 160;
+// 最多生成的缩略图数量及最小间隔（秒）
+const int kMaxThumbs = 100;
+const double kMinInterval = 2.0;
+// 图集每行的缩略图数量
+const int kAtlasColumns = 10;
+// 每次定位后最多读取的视频包数量，防止损坏文件导致长时间读取
+const int kMaxPacketsPerSeek = 64;
+
+}
+
+ThumbnailProvider::ThumbnailProvider(QObject *parent)
+    : QObject(parent)
+{
+    setMaxCacheBytes(8 * 1024 * 1024);
+}
+
+ThumbnailProvider::~ThumbnailProvider()
+{
+    stopWorker();
+}
+
+void ThumbnailProvider::setFile(const std::string &url)
+{
+    clear();
+    thread_ = QThread::create([this,url]{
+        workerFunc(url);
+    });
+    // 预览只在空闲时生成，不与播放线程争抢CPU
+    thread_->start(QThread::LowestPriority);
+}
+
+void ThumbnailProvider::clear()
+{
+    stopWorker();
+    {
+        std::lock_guard<std::mutex> lock(reqMtx_);
+        wanted_ = -1;
+    }
+    std::lock_guard<std::mutex> lock(cacheMtx_);
+    cache_.clear();
+    duration_ = 0.0;
+    count_ = 0;
+    atlas_ = QImage();
+    done_.clear();
+}
+
+QImage ThumbnailProvider::thumbnailAt(double pos)
+{
+    int index = indexAt(pos);
+    if(index < 0)
+        return QImage();
+    {
+        std::lock_guard<std::mutex> lock(cacheMtx_);
+        if(QImage* img = cache_.object(index))
+            return *img;
+    }
+    // 未命中，通知工作线程优先处理该位置
+    {
+        std::lock_guard<std::mutex> lock(reqMtx_);
+        wanted_ = index;
+    }
+    reqCv_.notify_one();
+    return QImage();
+}
+
+int ThumbnailProvider::indexAt(double pos) const
+{
+    std::lock_guard<std::mutex> lock(cacheMtx_);
+    if(count_ <= 0)
+        return -1;
+    return std::clamp(static_cast<int>(pos * count_),0,count_ - 1);
+}
+
+double ThumbnailProvider::duration() const
+{
+    std::lock_guard<std::mutex> lock(cacheMtx_);
+    return duration_;
+}
+
+void ThumbnailProvider::setMaxCacheBytes(int bytes)
+{
+    std::lock_guard<std::mutex> lock(cacheMtx_);
+    // 缓存代价以KB计
+    cache_.setMaxCost(std::max(1,bytes / 1024));
+}
+
+void ThumbnailProvider::stopWorker()
+{
+    if(!thread_)
+        return;
+    cancel_ = true;
+    reqCv_.notify_all();
+    thread_->wait();
+    delete thread_;
+    thread_ = nullptr;
+    cancel_ = false;
+}
+
+void ThumbnailProvider::workerFunc(std::string url)
+{
+    QFileInfo info(QString::fromStdString(url));
+    fileSize_ = info.size();
+    mtime_ = info.lastModified().toMSecsSinceEpoch();
+    QString path = atlasPath(url);
+
+    int count = 0;
+    if(loadAtlas(path)){
+        std::lock_guard<std::mutex> lock(cacheMtx_);
+        count = count_;
+        done_.assign(count,true);
+    }
+    else if(openInput(url)){
+        double duration = 0.0;
+        if(fmtCtx_->duration != AV_NOPTS_VALUE)
+            duration = fmtCtx_->duration / static_cast<double>(AV_TIME_BASE);
+        if(duration > 0.0)
+            count = std::min(kMaxThumbs,static_cast<int>(std::ceil(duration / kMinInterval)));
+        int rows = (count + kAtlasColumns - 1) / kAtlasColumns;
+        {
+            std::lock_guard<std::mutex> lock(cacheMtx_);
+            duration_ = duration;
+            count_ = count;
+            done_.assign(count,false);
+            if(count > 0){
+                atlas_ = QImage(tileWidth_ * kAtlasColumns,tileHeight_ * rows,QImage::Format_RGB32);
+                atlas_.fill(0);
+            }
+        }
+
+        // 顺序生成，悬停请求的位置插队
+        double interval = count > 0 ? duration / count : 0.0;
+        int next = 0;
+        int generated = 0;
+        while(!cancel_ && generated < count){
+            int index = -1;
+            {
+                std::lock_guard<std::mutex> lock(reqMtx_);
+                std::swap(index,wanted_);
+            }
+            if(index < 0 || done_[index]){
+                if(index >= 0)
+                    storeTile(index,QImage());
+                while(next < count && done_[next])
+                    ++next;
+                index = next;
+            }
+            QImage img = decodeAt(index * interval);
+            if(cancel_)
+                break;
+            {
+                // 解码失败的位置保留黑色，避免反复重试
+                std::lock_guard<std::mutex> lock(cacheMtx_);
+                if(!img.isNull()){
+                    QPainter painter(&atlas_);
+                    painter.drawImage((index % kAtlasColumns) * tileWidth_,
+                                      (index / kAtlasColumns) * tileHeight_,img);
+                }
+                done_[index] = true;
+            }
+            ++generated;
+            storeTile(index,QImage());
+        }
+        closeInput();
+        if(!cancel_ && count > 0)
+            saveAtlas(path);
+    }
+
+    // 生成完成后只响应悬停请求，把被LRU淘汰的缩略图从图集中恢复
+    while(!cancel_ && count > 0){
+        int index = -1;
+        {
+            std::unique_lock<std::mutex> lock(reqMtx_);
+            reqCv_.wait(lock,[this]{
+                return cancel_ || wanted_ >= 0;
+            });
+            std::swap(index,wanted_);
+        }
+        if(index >= 0)
+            storeTile(index,QImage());
+    }
+}
+
+bool ThumbnailProvider::openInput(const std::string &url)
+{
+    if(avformat_open_input(&fmtCtx_,url.c_str(),nullptr,nullptr) < 0)
+        return false;
+    if(avformat_find_stream_info(fmtCtx_,nullptr) < 0){
+        closeInput();
+        return false;
+    }
+    streamIndex_ = av_find_best_stream(fmtCtx_,AVMEDIA_TYPE_VIDEO,-1,-1,nullptr,0);
+    if(streamIndex_ < 0){
+        closeInput();
+        return false;
+    }
+    AVStream* st = fmtCtx_->streams[streamIndex_];
+    AVCodec* codec = avcodec_find_decoder(st->codecpar->codec_id);
+    if(!codec){
+        closeInput();
+        return false;
+    }
+    // 只读取视频流
+    for(unsigned i = 0; i < fmtCtx_->nb_streams; ++i)
+        fmtCtx_->streams[i]->discard = static_cast<int>(i) == streamIndex_ ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+    codecCtx_ = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codecCtx_,st->codecpar);
+    // 单线程解码且只解关键帧，尽量减小对播放的影响
+    codecCtx_->thread_count = 1;
+    codecCtx_->skip_frame = AVDISCARD_NONKEY;
+    if(avcodec_open2(codecCtx_,codec,nullptr) < 0 || codecCtx_->width <= 0 || codecCtx_->height <= 0){
+        closeInput();
+        return false;
+    }
+
+    double sar = 1.0;
+    if(st->codecpar->sample_aspect_ratio.num > 0 && st->codecpar->sample_aspect_ratio.den > 0)
+        sar = av_q2d(st->codecpar->sample_aspect_ratio);
+    tileWidth_ = kTileWidth;
+    tileHeight_ = static_cast<int>(kTileWidth * codecCtx_->height / (codecCtx_->width * sar));
+    tileHeight_ = std::max(2,tileHeight_ & ~1);
+
+    frame_ = av_frame_alloc();
+    pkt_ = av_packet_alloc();
+    return true;
+}
+
+void ThumbnailProvider::closeInput()
+{
+    if(swsCtx_){
+        sws_freeContext(swsCtx_);
+        swsCtx_ = nullptr;
+    }
+    av_packet_free(&pkt_);
+    av_frame_free(&frame_);
+    avcodec_free_context(&codecCtx_);
+    avformat_close_input(&fmtCtx_);
+    streamIndex_ = -1;
+}
+
+QImage ThumbnailProvider::decodeAt(double t)
+{
+    AVStream* st = fmtCtx_->streams[streamIndex_];
+    int64_t ts = static_cast<int64_t>(t / av_q2d(st->time_base));
+    if(st->start_time != AV_NOPTS_VALUE)
+        ts += st->start_time;
+    if(av_seek_frame(fmtCtx_,streamIndex_,ts,AVSEEK_FLAG_BACKWARD) < 0)
+        return QImage();
+    avcodec_flush_buffers(codecCtx_);
+
+    bool gotFrame = false;
+    int packets = 0;
+    while(!cancel_ && !gotFrame && packets < kMaxPacketsPerSeek){
+        int ret = av_read_frame(fmtCtx_,pkt_);
+        if(ret < 0){
+            // 文件末尾，取出解码器中剩余的帧
+            avcodec_send_packet(codecCtx_,nullptr);
+            gotFrame = avcodec_receive_frame(codecCtx_,frame_) == 0;
+            break;
+        }
+        if(pkt_->stream_index == streamIndex_){
+            ++packets;
+            avcodec_send_packet(codecCtx_,pkt_);
+            gotFrame = avcodec_receive_frame(codecCtx_,frame_) == 0;
+        }
+        av_packet_unref(pkt_);
+    }
+    if(!gotFrame)
+        return QImage();
+
+    swsCtx_ = sws_getCachedContext(swsCtx_,frame_->width,frame_->height,static_cast<AVPixelFormat>(frame_->format),
+                                   tileWidth_,tileHeight_,AV_PIX_FMT_RGB32,SWS_BILINEAR,nullptr,nullptr,nullptr);
+    if(!swsCtx_){
+        av_frame_unref(frame_);
+        return QImage();
+    }
+    QImage img(tileWidth_,tileHeight_,QImage::Format_RGB32);
+    uint8_t* dst[4] = {img.bits(),nullptr,nullptr,nullptr};
+    int dstStride[4] = {static_cast<int>(img.bytesPerLine()),0,0,0};
+    sws_scale(swsCtx_,frame_->data,frame_->linesize,0,frame_->height,dst,dstStride);
+    av_frame_unref(frame_);
+    return img;
+}
+
+bool ThumbnailProvider::loadAtlas(const QString &path)
+{
+    QFile file(path);
+    if(path.isEmpty() || !file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0;
+    qint64 fileSize = 0, mtime = 0;
+    qint32 count = 0, tileW = 0, tileH = 0;
+    double duration = 0.0;
+    QByteArray jpeg;
+    in >> magic >> fileSize >> mtime >> count >> tileW >> tileH >> duration >> jpeg;
+    // 文件已修改，缓存作废
+    if(in.status() != QDataStream::Ok || magic != kAtlasMagic
+        || fileSize != fileSize_ || mtime != mtime_ || count <= 0 || tileW <= 0 || tileH <= 0)
+        return false;
+
+    QImage atlas;
+    if(!atlas.loadFromData(jpeg,"JPG"))
+        return false;
+    int rows = (count + kAtlasColumns - 1) / kAtlasColumns;
+    if(atlas.width() < tileW * kAtlasColumns || atlas.height() < tileH * rows)
+        return false;
+
+    std::lock_guard<std::mutex> lock(cacheMtx_);
+    atlas_ = atlas.convertToFormat(QImage::Format_RGB32);
+    tileWidth_ = tileW;
+    tileHeight_ = tileH;
+    duration_ = duration;
+    count_ = count;
+    qDebug() << "thumbnail atlas loaded:" << count << "thumbnails";
+    return true;
+}
+
+bool ThumbnailProvider::saveAtlas(const QString &path) const
+{
+    if(path.isEmpty())
+        return false;
+    QByteArray jpeg;
+    QBuffer buffer(&jpeg);
+    buffer.open(QIODevice::WriteOnly);
+    {
+        std::lock_guard<std::mutex> lock(cacheMtx_);
+        if(!atlas_.save(&buffer,"JPG",85))
+            return false;
+    }
+
+    QFileInfo info(path);
+    QDir().mkpath(info.absolutePath());
+    QSaveFile file(info.absoluteFilePath());
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << kAtlasMagic << fileSize_ << mtime_ << qint32(count_) << qint32(tileWidth_) << qint32(tileHeight_)
+        << duration_ << jpeg;
+    return file.commit();
+}
+
+void ThumbnailProvider::storeTile(int index, const QImage &img)
+{
+    {
+        std::lock_guard<std::mutex> lock(cacheMtx_);
+        if(index < 0 || index >= count_ || !done_[index])
+            return;
+        // 未传入图像时从图集中截取
+        QImage* tile = new QImage(img.isNull()
+                                      ? atlas_.copy((index % kAtlasColumns) * tileWidth_,
+                                                    (index / kAtlasColumns) * tileHeight_,
+                                                    tileWidth_,tileHeight_)
+                                      : img);
+        int cost = std::max(1,static_cast<int>(tile->sizeInBytes() / 1024));
+        cache_.insert(index,tile,cost);
+    }
+    emit thumbnailReady(index);
+}
+
+QString ThumbnailProvider::atlasPath(const std::string &url) const
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if(dir.isEmpty())
+        return QString();
+    QString absPath = QFileInfo(QString::fromStdString(url)).absoluteFilePath();
+    QByteArray key = QCryptographicHash::hash(absPath.toUtf8(),QCryptographicHash::Md5).toHex();
+    return QDir(dir).filePath(QStringLiteral("thumbnails/") + QString::fromLatin1(key) + QStringLiteral(".thb"));
+}
@@ -0,0 +1,92 @@
+#ifndef THUMBNAILPROVIDER_H
+#define THUMBNAILPROVIDER_H
+
+#include <QObject>
+#include <QImage>
+#include <QCache>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+class QThread;
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+// 进度条悬停预览缩略图
+// 使用独立的解复用/解码实例在低优先级线程中按固定间隔抽取关键帧，
+// 与Player的解码线程互不干扰。缩略图缩小后放入按内存大小限制的LRU缓存，
+// 全部生成后拼成一张图集存到磁盘，再次打开同一文件时直接载入。
+class ThumbnailProvider : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ThumbnailProvider(QObject* parent = nullptr);
+    ~ThumbnailProvider();
+
+    // 切换文件，取消正在进行的生成任务
+    void setFile(const std::string& url);
+    // 取消生成并清空缓存
+    void clear();
+
+    // 获取进度pos(0~1)处的缩略图，尚未生成时返回空图像并优先生成该位置
+    QImage thumbnailAt(double pos);
+    // pos对应的缩略图序号
+    int indexAt(double pos) const;
+    // 当前文件时长（秒），未知时为0
+    double duration() const;
+
+    // 内存缓存上限（字节）
+    void setMaxCacheBytes(int bytes);
+
+signals:
+    // 某个缩略图已生成，可刷新预览（在工作线程中发出）
+    void thumbnailReady(int index);
+
+private:
+    void stopWorker();
+    void workerFunc(std::string url);
+
+    // 以下函数仅在工作线程中调用
+    bool openInput(const std::string& url);
+    void closeInput();
+    // 定位到t秒之前的关键帧并解码一帧，缩放为缩略图
+    QImage decodeAt(double t);
+    bool loadAtlas(const QString& path);
+    bool saveAtlas(const QString& path) const;
+    void storeTile(int index, const QImage& img);
+    QString atlasPath(const std::string& url) const;
+
+    QThread* thread_ = nullptr;
+    std::atomic<bool> cancel_{false};
+
+    // 等待悬停请求
+    std::mutex reqMtx_;
+    std::condition_variable reqCv_;
+    int wanted_ = -1;
+
+    mutable std::mutex cacheMtx_;
+    QCache<int,QImage> cache_;
+    double duration_ = 0.0;
+    int count_ = 0;
+
+    // 工作线程私有状态
+    AVFormatContext* fmtCtx_ = nullptr;
+    AVCodecContext* codecCtx_ = nullptr;
+    AVFrame* frame_ = nullptr;
+    AVPacket* pkt_ = nullptr;
+    SwsContext* swsCtx_ = nullptr;
+    int streamIndex_ = -1;
+    int tileWidth_ = 0;
+    int tileHeight_ = 0;
+    qint64 fileSize_ = 0;
+    qint64 mtime_ = 0;
+    // 图集保存全部缩略图，LRU被淘汰后从这里恢复
+    QImage atlas_;
+    std::vector<bool> done_;
+};
+
+#endif // THUMBNAILPROVIDER_H
@@ -0,0 +1,245 @@
+#include "timestretch.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIMESTRETCH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// 内积与b的能量
+void dotEnergy(const float* a, const float* b, int n, float& dot, float& energy)
+{
+    int i = 0;
+    float d = 0.0f, e = 0.0f;
+#ifdef TIMESTRETCH_SSE2
+    __m128 vd = _mm_setzero_ps();
+    __m128 ve = _mm_setzero_ps();
+    for(; i + 4 <= n; i += 4){
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        vd = _mm_add_ps(vd,_mm_mul_ps(va,vb));
+        ve = _mm_add_ps(ve,_mm_mul_ps(vb,vb));
+    }
+    alignas(16) float td[4], te[4];
+    _mm_store_ps(td,vd);
+    _mm_store_ps(te,ve);
+    d = td[0] + td[1] + td[2] + td[3];
+    e = te[0] + te[1] + te[2] + te[3];
+#endif
+    for(; i < n; ++i){
+        d += a[i] * b[i];
+        e += b[i] * b[i];
+    }
+    dot = d;
+    energy = e;
+}
+
+// out = tail * (1 - fade) + cur * fade
+void crossfade(const float* tail, const float* cur, const float* fade, float* out, int n)
+{
+    int i = 0;
+#ifdef TIMESTRETCH_SSE2
+    for(; i + 4 <= n; i += 4){
+        __m128 t = _mm_loadu_ps(tail + i);
+        __m128 f = _mm_loadu_ps(fade + i);
+        __m128 c = _mm_loadu_ps(cur + i);
+        _mm_storeu_ps(out + i,_mm_add_ps(t,_mm_mul_ps(f,_mm_sub_ps(c,t))));
+    }
+#endif
+    for(; i < n; ++i)
+        out[i] = tail[i] + fade[i] * (cur[i] - tail[i]);
+}
+
+}
+
+void TimeStretch::configure(int sampleRate, int channels)
+{
+    channels_ = std::max(1,channels);
+    // 分析帧约24ms，交叠一半；搜索范围约±8ms，足以覆盖语音和大部分音乐的基音周期
+    overlap_ = std::max(32,sampleRate * 12 / 1000);
+    seekRange_ = std::max(16,sampleRate * 8 / 1000);
+
+    // 升余弦淡入窗，按声道交错展开以便逐样本向量化
+    fadeIn_.resize(static_cast<size_t>(overlap_) * channels_);
+    for(int i = 0; i < overlap_; ++i){
+        float w = 0.5f - 0.5f * std::cos(3.14159265f * (i + 0.5f) / overlap_);
+        for(int c = 0; c < channels_; ++c)
+            fadeIn_[static_cast<size_t>(i) * channels_ + c] = w;
+    }
+    tail_.assign(static_cast<size_t>(overlap_) * channels_,0.0f);
+    clear();
+}
+
+void TimeStretch::setSpeed(double speed)
+{
+    speed_ = std::clamp(speed,0.5,2.0);
+}
+
+void TimeStretch::push(const float *in, int frames)
+{
+    size_t base = in_.size();
+    in_.resize(base + static_cast<size_t>(frames) * channels_);
+    size_t monoBase = mono_.size();
+    mono_.resize(monoBase + frames);
+    float* dst = in_.data() + base;
+    float* mono = mono_.data() + monoBase;
+    float scale = 1.0f / channels_;
+    for(int i = 0; i < frames; ++i){
+        float sum = 0.0f;
+        for(int c = 0; c < channels_; ++c){
+            float v = in[i * channels_ + c];
+            dst[i * channels_ + c] = v;
+            sum += v;
+        }
+        mono[i] = sum * scale;
+    }
+
+    // 每个分析帧需要名义位置之后 搜索范围 + 两倍交叠 的输入
+    int frameLen = 2 * overlap_;
+    while(true){
+        int64_t nominal = static_cast<int64_t>(std::llround(anaPos_));
+        int64_t inEnd = inStart_ + static_cast<int64_t>(mono_.size());
+        if(nominal + seekRange_ + frameLen > inEnd)
+            break;
+        step();
+    }
+    compact();
+}
+
+void TimeStretch::step()
+{
+    int64_t nominal = static_cast<int64_t>(std::llround(anaPos_));
+    int64_t best = nominal;
+    if(prevBest_ >= 0){
+        // 模板为上一帧在原信号中的自然延续，在名义位置附近找与它最相似的起点
+        const float* tmpl = mono_.data() + (prevBest_ + overlap_ - inStart_);
+        int64_t from = std::max(inStart_,nominal - seekRange_);
+        int64_t to = nominal + seekRange_;
+        // 粗搜每4帧一个候选，再在最佳点附近逐帧细搜
+        int64_t coarse = search(tmpl,from,to,4);
+        best = search(tmpl,std::max(from,coarse - 3),std::min(to,coarse + 3),1);
+    }
+
+    size_t n = static_cast<size_t>(overlap_) * channels_;
+    const float* cur = in_.data() + (best - inStart_) * channels_;
+    size_t outBase = out_.size();
+    out_.resize(outBase + n);
+    if(prevBest_ >= 0)
+        crossfade(tail_.data(),cur,fadeIn_.data(),out_.data() + outBase,static_cast<int>(n));
+    else
+        std::copy(cur,cur + n,out_.begin() + outBase);
+    // 保存后半段
+    std::copy(cur + n,cur + 2 * n,tail_.begin());
+
+    prevBest_ = best;
+    anaPos_ += overlap_ * speed_;
+}
+
+int64_t TimeStretch::search(const float *tmpl, int64_t from, int64_t to, int stride) const
+{
+    int64_t best = from;
+    float bestScore = -1e30f;
+    for(int64_t pos = from; pos <= to; pos += stride){
+        float dot, energy;
+        dotEnergy(tmpl,mono_.data() + (pos - inStart_),overlap_,dot,energy);
+        // 归一化互相关，只比较大小，省去模板能量和开方：dot*|dot|/energy
+        float score = dot * std::fabs(dot) / (energy + 1.0f);
+        if(score > bestScore){
+            bestScore = score;
+            best = pos;
+        }
+    }
+    return best;
+}
+
+void TimeStretch::compact()
+{
+    // 下一个分析帧的搜索起点和模板起点之前的输入都不会再被使用
+    int64_t keep = static_cast<int64_t>(std::llround(anaPos_)) - seekRange_;
+    if(prevBest_ >= 0)
+        keep = std::min(keep,prevBest_ + overlap_);
+    int64_t drop = keep - inStart_;
+    // 攒够一定量再搬移，摊薄拷贝开销
+    if(drop < 4096)
+        return;
+    in_.erase(in_.begin(),in_.begin() + drop * channels_);
+    mono_.erase(mono_.begin(),mono_.begin() + drop);
+    inStart_ += drop;
+}
+
+int TimeStretch::available() const
+{
+    return static_cast<int>((out_.size() - outPos_) / channels_);
+}
+
+int TimeStretch::pull(float *out, int maxFrames)
+{
+    int frames = std::min(maxFrames,available());
+    size_t n = static_cast<size_t>(frames) * channels_;
+    std::copy(out_.begin() + outPos_,out_.begin() + outPos_ + n,out);
+    outPos_ += n;
+    if(outPos_ == out_.size()){
+        out_.clear();
+        outPos_ = 0;
+    }
+    return frames;
+}
+
+void TimeStretch::flush()
+{
+    // 已输出的部分对应到名义位置为止的输入，其后的输入原速接上
+    int64_t nominal = static_cast<int64_t>(std::llround(anaPos_));
+    int64_t inEnd = inStart_ + static_cast<int64_t>(mono_.size());
+    nominal = std::clamp(nominal,inStart_,inEnd);
+    size_t n = static_cast<size_t>(inEnd - nominal) * channels_;
+    const float* cur = in_.data() + (nominal - inStart_) * channels_;
+    size_t outBase = out_.size();
+    out_.resize(outBase + n);
+    size_t fade = 0;
+    if(prevBest_ >= 0){
+        // 与上一帧的后半段交叠，剩余不足一个交叠长度时只淡入一部分
+        fade = std::min(n,static_cast<size_t>(overlap_) * channels_);
+        crossfade(tail_.data(),cur,fadeIn_.data(),out_.data() + outBase,static_cast<int>(fade));
+    }
+    std::copy(cur + fade,cur + n,out_.begin() + outBase + fade);
+
+    in_.clear();
+    mono_.clear();
+    inStart_ = 0;
+    anaPos_ = 0.0;
+    prevBest_ = -1;
+}
+
+void TimeStretch::finish()
+{
+    // 剩余输入按当前倍速应产生的输出帧数
+    int64_t inEnd = inStart_ + static_cast<int64_t>(mono_.size());
+    double remaining = std::max(0.0,(inEnd - anaPos_) / speed_);
+    size_t target = out_.size() + static_cast<size_t>(std::llround(remaining)) * channels_;
+    // 补足后名义位置能越过真实输入的末尾，多出的输出来自静音，截掉
+    int pad = seekRange_ + 3 * overlap_;
+    std::vector<float> silence(static_cast<size_t>(pad) * channels_,0.0f);
+    push(silence.data(),pad);
+    if(out_.size() > target)
+        out_.resize(target);
+
+    in_.clear();
+    mono_.clear();
+    inStart_ = 0;
+    anaPos_ = 0.0;
+    prevBest_ = -1;
+}
+
+void TimeStretch::clear()
+{
+    in_.clear();
+    mono_.clear();
+    out_.clear();
+    outPos_ = 0;
+    inStart_ = 0;
+    anaPos_ = 0.0;
+    prevBest_ = -1;
+}
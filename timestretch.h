@@ -0,0 +1,69 @@
+#ifndef TIMESTRETCH_H
+#define TIMESTRETCH_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// 变速不变调处理器（WSOLA）
+// 按倍速间隔从输入中取分析帧，在附近的搜索范围内找与上一帧自然延续最相似的位置，
+// 再以固定的合成间隔交叠相加输出，因此音高不变、时长按倍速缩放。
+// 相似度在各声道混合后的单声道信号上计算，先粗搜再细搜，内积使用SSE2。
+// 输入输出为交错的float PCM，在音频解码线程中调用，不可跨线程使用。
+class TimeStretch
+{
+public:
+    TimeStretch() = default;
+
+    // 设置格式并清空状态
+    void configure(int sampleRate, int channels);
+    // 0.5~2.0，1.0时调用方应直接旁路
+    void setSpeed(double speed);
+    double speed() const { return speed_; }
+
+    // 送入frames帧输入，处理所有足够长的分析帧
+    void push(const float* in, int frames);
+    // 已产生、可取出的输出帧数
+    int available() const;
+    // 取出最多maxFrames帧输出，返回实际帧数
+    int pull(float* out, int maxFrames);
+    // 把尚未分析的输入原样接在输出末尾（开头与上一帧交叠），并清空输入状态；
+    // 退出变速时调用，输出的帧数等于剩余的媒体时长，不丢失音频
+    void flush();
+    // 输入结束（文件结尾）时调用：补静音让剩余输入按当前倍速处理完，只保留对应真实输入的输出，并清空输入状态
+    void finish();
+    // 丢弃所有缓存的输入和输出（跳转时）
+    void clear();
+
+private:
+    // 处理一个分析帧，输出overlap_帧
+    void step();
+    // 在[from,to]中以stride为步长搜索与模板最相似的起点（绝对帧号）
+    int64_t search(const float* tmpl, int64_t from, int64_t to, int stride) const;
+    // 丢弃已不会再用到的输入
+    void compact();
+
+    int channels_ = 2;
+    int overlap_ = 0;       // 交叠长度，也是每个分析帧输出的帧数
+    int seekRange_ = 0;     // 相似度搜索范围（单侧）
+    double speed_ = 1.0;
+
+    // 交错的输入及其单声道混合，inStart_为in_[0]对应的绝对帧号
+    std::vector<float> in_;
+    std::vector<float> mono_;
+    int64_t inStart_ = 0;
+    // 下一个分析帧的名义位置，以及上一帧选中的位置（绝对帧号）
+    double anaPos_ = 0.0;
+    int64_t prevBest_ = -1;
+
+    // 上一帧的后半段，与下一帧的前半段交叠相加
+    std::vector<float> tail_;
+    // 交错展开的淡入窗（淡出窗为1减淡入窗）
+    std::vector<float> fadeIn_;
+
+    // 交错的输出，outPos_之前的已被取走
+    std::vector<float> out_;
+    size_t outPos_ = 0;
+};
+
+#endif // TIMESTRETCH_H
@@ -0,0 +1,333 @@
+#include "uploadbufferpool.h"
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QSurfaceFormat>
+#include <QDebug>
+#include <algorithm>
+
+extern "C"{
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/mem.h>
+}
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+namespace {
+
+// 平面起始地址和行跨度的对齐，满足AVX-512
+const int kAlign = 64;
+// 每个平面末尾的额外空间，部分解码器的SIMD代码会越界读取
+const int kPlanePadding = 64;
+// 尺寸变化后先创建的缓冲数，之后按缺口逐步增加
+const int kInitialSlots = 8;
+const int kGrowStep = 2;
+// 上限：参考帧 + 帧级多线程 + 帧队列 + 正在显示的帧
+const int kMaxSlots = 32;
+
+size_t alignUp(size_t v, size_t a)
+{
+    return (v + a - 1) / a * a;
+}
+
+}
+
+UploadBufferPool::UploadBufferPool()
+{
+
+}
+
+UploadBufferPool::~UploadBufferPool()
+{
+    // GL资源应已由releaseGL释放，这里只处理系统内存
+    for(Slot& slot : slots_){
+        if(!slot.pbo)
+            av_freep(&slot.ptr);
+    }
+}
+
+void UploadBufferPool::initGL(QOpenGLContext *ctx)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(!ctx)
+        return;
+    gl_ = ctx->extraFunctions();
+
+    // 持久映射需要buffer_storage，重用前的等待需要fence
+    QSurfaceFormat fmt = ctx->format();
+    bool es = ctx->isOpenGLES();
+    bool storage = es ? ctx->hasExtension("GL_EXT_buffer_storage")
+                      : (fmt.majorVersion() > 4 || (fmt.majorVersion() == 4 && fmt.minorVersion() >= 4)
+                         || ctx->hasExtension("GL_ARB_buffer_storage"));
+    bool sync = es ? fmt.majorVersion() >= 3
+                   : (fmt.majorVersion() > 3 || (fmt.majorVersion() == 3 && fmt.minorVersion() >= 2)
+                      || ctx->hasExtension("GL_ARB_sync"));
+    if(storage && sync)
+        glBufferStorage_ = reinterpret_cast<BufferStorageFn>(ctx->getProcAddress(es ? "glBufferStorageEXT" : "glBufferStorage"));
+
+    mode_ = glBufferStorage_ ? Mode::Persistent : Mode::Staging;
+    qDebug() << "upload buffer pool:" << (mode_ == Mode::Persistent ? "persistent mapped PBO" : "staging memory");
+}
+
+void UploadBufferPool::maintain()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(mode_ == Mode::None)
+        return;
+
+    // 回收GPU已经读取完毕的缓冲
+    for(Slot& slot : slots_){
+        if(!slot.fence)
+            continue;
+        GLenum r = gl_->glClientWaitSync(slot.fence,0,0);
+        if(r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED){
+            gl_->glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+            slot.gpuBusy = false;
+        }
+    }
+
+    // 帧尺寸或格式变化，淘汰旧尺寸的缓冲
+    if(wantedSize_ && wantedSize_ != slotSize_){
+        for(Slot& slot : slots_)
+            slot.retired = true;
+        slotSize_ = wantedSize_;
+        shortage_ = kInitialSlots;
+    }
+    wantedSize_ = 0;
+
+    int live = 0;
+    for(Slot& slot : slots_){
+        if(!slot.ptr)
+            continue;
+        if(slot.retired && !slot.cpuBusy && !slot.gpuBusy)
+            destroySlot(slot);
+        else if(!slot.retired)
+            ++live;
+    }
+
+    // 尺寸刚变化时一次创建一批，平时每次最多补kGrowStep个
+    int grow = shortage_ >= kInitialSlots ? shortage_ : std::min(shortage_,kGrowStep);
+    grow = std::min(grow,kMaxSlots - live);
+    for(int i = 0; i < grow; ++i){
+        if(!createSlot(slotSize_))
+            break;
+    }
+    shortage_ = 0;
+}
+
+bool UploadBufferPool::locate(const AVFrame *frame, Region &out)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(mode_ != Mode::Persistent || !frame || !frame->data[0])
+        return false;
+    const uint8_t* p = frame->data[0];
+    for(size_t i = 0; i < slots_.size(); ++i){
+        const Slot& slot = slots_[i];
+        if(slot.ptr && p >= slot.ptr && p < slot.ptr + slot.size){
+            out.pbo = slot.pbo;
+            out.base = slot.ptr;
+            out.slot = static_cast<int>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void UploadBufferPool::markUploaded(int slot)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(slot < 0 || slot >= static_cast<int>(slots_.size()))
+        return;
+    Slot& s = slots_[slot];
+    if(s.fence)
+        gl_->glDeleteSync(s.fence);
+    s.fence = gl_->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+    s.gpuBusy = s.fence != nullptr;
+}
+
+void UploadBufferPool::releaseGL()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    for(Slot& slot : slots_){
+        if(slot.ptr)
+            destroySlot(slot);
+    }
+    slots_.clear();
+    mode_ = Mode::None;
+    slotSize_ = 0;
+    gl_ = nullptr;
+}
+
+UploadBufferPool::Mode UploadBufferPool::mode() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return mode_;
+}
+
+uint64_t UploadBufferPool::pooledFrames() const
+{
+    return pooled_.load(std::memory_order_relaxed);
+}
+
+uint64_t UploadBufferPool::fallbackFrames() const
+{
+    return fallback_.load(std::memory_order_relaxed);
+}
+
+int UploadBufferPool::getBuffer2(AVCodecContext *ctx, AVFrame *frame, int flags)
+{
+    UploadBufferPool* pool = static_cast<UploadBufferPool*>(ctx->opaque);
+    AVPixelFormat fmt = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+    if(!pool || !desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM))
+        || !(ctx->codec->capabilities & AV_CODEC_CAP_DR1))
+        return avcodec_default_get_buffer2(ctx,frame,flags);
+
+    // 按解码器要求对齐宽高和行跨度，与默认分配器一致
+    int w = frame->width;
+    int h = frame->height;
+    int strideAlign[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx,&w,&h,strideAlign);
+    int linesize[4] = {0};
+    if(av_image_fill_linesizes(linesize,fmt,w) < 0)
+        return avcodec_default_get_buffer2(ctx,frame,flags);
+
+    // 所有平面放在同一块缓冲中，上传时只需绑定一个PBO
+    int planes = av_pix_fmt_count_planes(fmt);
+    size_t offsets[4] = {0};
+    size_t total = 0;
+    for(int i = 0; i < planes; ++i){
+        int a = std::max(kAlign,strideAlign[i]);
+        linesize[i] = static_cast<int>(alignUp(linesize[i],a));
+        bool chroma = (i == 1 || i == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int planeH = chroma ? -((-h) >> desc->log2_chroma_h) : h;
+        offsets[i] = total;
+        total = alignUp(total + static_cast<size_t>(linesize[i]) * planeH + kPlanePadding,kAlign);
+    }
+
+    uint8_t* base = nullptr;
+    int slot = pool->acquire(total,&base);
+    if(slot < 0){
+        pool->fallback_.fetch_add(1,std::memory_order_relaxed);
+        return avcodec_default_get_buffer2(ctx,frame,flags);
+    }
+
+    Lease* lease = new Lease{pool->shared_from_this(),slot};
+    frame->buf[0] = av_buffer_create(base,static_cast<int>(total),&UploadBufferPool::freeLease,lease,0);
+    if(!frame->buf[0]){
+        pool->release(slot);
+        delete lease;
+        return AVERROR(ENOMEM);
+    }
+    for(int i = 0; i < planes; ++i){
+        frame->data[i] = base + offsets[i];
+        frame->linesize[i] = linesize[i];
+    }
+    frame->extended_data = frame->data;
+    pool->pooled_.fetch_add(1,std::memory_order_relaxed);
+    return 0;
+}
+
+int UploadBufferPool::acquire(size_t size, uint8_t **ptr)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(mode_ == Mode::None)
+        return -1;
+    if(size != slotSize_){
+        // 由渲染线程在下一次maintain中按新尺寸创建
+        wantedSize_ = size;
+        return -1;
+    }
+    for(size_t i = 0; i < slots_.size(); ++i){
+        Slot& slot = slots_[i];
+        if(slot.ptr && !slot.retired && !slot.cpuBusy && !slot.gpuBusy){
+            slot.cpuBusy = true;
+            *ptr = slot.ptr;
+            return static_cast<int>(i);
+        }
+    }
+    ++shortage_;
+    return -1;
+}
+
+void UploadBufferPool::release(int slot)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    if(slot >= 0 && slot < static_cast<int>(slots_.size()))
+        slots_[slot].cpuBusy = false;
+}
+
+void UploadBufferPool::freeLease(void *opaque, uint8_t *data)
+{
+    Q_UNUSED(data);
+    Lease* lease = static_cast<Lease*>(opaque);
+    lease->pool->release(lease->slot);
+    delete lease;
+}
+
+bool UploadBufferPool::createSlot(size_t size)
+{
+    Slot slot;
+    slot.size = size;
+    if(mode_ == Mode::Persistent){
+        // 解码器会回读参考帧，请求客户端可读的缓存内存而不是写合并的显存映射
+        const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        gl_->glGenBuffers(1,&slot.pbo);
+        gl_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER,slot.pbo);
+        glBufferStorage_(GL_PIXEL_UNPACK_BUFFER,static_cast<GLsizeiptr>(size),nullptr,mapFlags | GL_CLIENT_STORAGE_BIT);
+        slot.ptr = static_cast<uint8_t*>(gl_->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,0,static_cast<GLsizeiptr>(size),mapFlags));
+        gl_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+        if(!slot.ptr){
+            // 驱动不支持，改用系统内存
+            gl_->glDeleteBuffers(1,&slot.pbo);
+            qDebug() << "persistent mapping failed, falling back to staging memory";
+            for(Slot& s : slots_)
+                s.retired = true;
+            mode_ = Mode::Staging;
+            slot.pbo = 0;
+        }
+    }
+    if(mode_ == Mode::Staging){
+        slot.ptr = static_cast<uint8_t*>(av_malloc(size));
+        if(!slot.ptr)
+            return false;
+    }
+
+    // 复用已释放的位置，正在使用中的Lease按下标引用
+    for(Slot& s : slots_){
+        if(!s.ptr){
+            s = slot;
+            return true;
+        }
+    }
+    slots_.push_back(slot);
+    return true;
+}
+
+void UploadBufferPool::destroySlot(Slot &slot)
+{
+    if(slot.fence){
+        gl_->glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+    if(slot.pbo){
+        gl_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER,slot.pbo);
+        gl_->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        gl_->glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+        gl_->glDeleteBuffers(1,&slot.pbo);
+        slot.ptr = nullptr;
+    }else{
+        av_freep(&slot.ptr);
+    }
+    slot = Slot();
+}
@@ -0,0 +1,101 @@
+#ifndef UPLOADBUFFERPOOL_H
+#define UPLOADBUFFERPOOL_H
+
+#include <QOpenGLFunctions>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+class QOpenGLContext;
+class QOpenGLExtraFunctions;
+struct AVCodecContext;
+struct AVFrame;
+struct __GLsync;
+
+// 视频解码输出缓冲池
+// 作为解码器的get_buffer2，让解码器直接把图像写进持久映射的像素解包缓冲区（PBO），
+// 渲染时从PBO上传纹理，省去一次系统内存到驱动的拷贝。
+// 驱动不支持持久映射时退化为对齐的系统内存池，没有GL环境时由FFmpeg默认分配。
+//
+// GL相关的函数（initGL/maintain/locate/markUploaded/releaseGL）只能在渲染线程、上下文为当前时调用；
+// getBuffer2可在任意解码线程调用，无空闲缓冲时立即回退到默认分配，不会阻塞解码。
+class UploadBufferPool : public std::enable_shared_from_this<UploadBufferPool>
+{
+public:
+    enum class Mode{
+        None,       // 未初始化，全部使用默认分配
+        Staging,    // 系统内存池
+        Persistent  // 持久映射的PBO
+    };
+
+    // 上传时需要的缓冲区信息
+    struct Region{
+        GLuint pbo = 0;             // 为0表示使用客户端内存
+        const uint8_t* base = nullptr;
+        int slot = -1;
+    };
+
+    UploadBufferPool();
+    ~UploadBufferPool();
+
+    // 检测当前上下文能力并选择模式
+    void initGL(QOpenGLContext* ctx);
+    // 每次绘制时调用：回收GPU已读完的缓冲，按解码器的需求创建或淘汰缓冲
+    void maintain();
+    // 帧数据是否位于池中，是则返回上传所需信息
+    bool locate(const AVFrame* frame, Region& out);
+    // 上传命令已提交，插入fence，GPU读取完成前该缓冲不会被重用
+    void markUploaded(int slot);
+    // 释放所有GL资源，之后全部使用默认分配，需保证解码器已关闭
+    void releaseGL();
+
+    Mode mode() const;
+    // 从池中分配的帧数与回退到默认分配的帧数
+    uint64_t pooledFrames() const;
+    uint64_t fallbackFrames() const;
+
+    // 设置到AVCodecContext上，opaque需指向UploadBufferPool
+    static int getBuffer2(AVCodecContext* ctx, AVFrame* frame, int flags);
+
+private:
+    struct Slot{
+        uint8_t* ptr = nullptr;
+        size_t size = 0;
+        GLuint pbo = 0;
+        __GLsync* fence = nullptr;
+        bool cpuBusy = false;   // 被解码器或帧引用持有
+        bool gpuBusy = false;   // 上传命令尚未执行完
+        bool retired = false;   // 尺寸已变化，空闲后释放
+    };
+    // 缓冲被AVBufferRef释放时归还，持有池的引用保证池在最后一帧释放前存活
+    struct Lease{
+        std::shared_ptr<UploadBufferPool> pool;
+        int slot;
+    };
+
+    int acquire(size_t size, uint8_t** ptr);
+    void release(int slot);
+    static void freeLease(void* opaque, uint8_t* data);
+
+    bool createSlot(size_t size);
+    void destroySlot(Slot& slot);
+
+    mutable std::mutex mtx_;
+    std::vector<Slot> slots_;
+    Mode mode_ = Mode::None;
+    // 当前缓冲尺寸，解码器需要的尺寸与缺少的缓冲数
+    size_t slotSize_ = 0;
+    size_t wantedSize_ = 0;
+    int shortage_ = 0;
+
+    QOpenGLExtraFunctions* gl_ = nullptr;
+    typedef void (QOPENGLF_APIENTRYP BufferStorageFn)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+    BufferStorageFn glBufferStorage_ = nullptr;
+
+    std::atomic<uint64_t> pooled_{0};
+    std::atomic<uint64_t> fallback_{0};
+};
+
+#endif // UPLOADBUFFERPOOL_H
@@ -0,0 +1,46 @@
+#include "videoframe.h"
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+VideoFrame::VideoFrame(const AVFrame *frame)
+{
+    frame_ = av_frame_alloc();
+    if(frame_ && frame && av_frame_ref(frame_,frame) < 0)
+        av_frame_unref(frame_);
+}
+
+VideoFrame::~VideoFrame()
+{
+    av_frame_free(&frame_);
+}
+
+const uint8_t *VideoFrame::data(int plane) const
+{
+    return frame_->data[plane];
+}
+
+int VideoFrame::linesize(int plane) const
+{
+    return frame_->linesize[plane];
+}
+
+int VideoFrame::getWidth() const
+{
+    return frame_->width;
+}
+
+int VideoFrame::getHeight() const
+{
+    return frame_->height;
+}
+
+int VideoFrame::format() const
+{
+    return frame_->format;
+}
+
+const AVFrame *VideoFrame::avFrame() const
+{
+    return frame_;
+}
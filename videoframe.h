@@ -0,0 +1,34 @@
+#ifndef VIDEOFRAME_H
+#define VIDEOFRAME_H
+
+#include <cstdint>
+#include <memory>
+#include <QMetaType>
+
+struct AVFrame;
+
+// 解码后的视频帧
+// 只持有解码器输出缓冲区的引用（av_frame_ref），不拷贝像素数据，
+// 最后一个shared_ptr释放时归还缓冲区。渲染时直接从各平面按行跨度上传。
+class VideoFrame {
+public:
+    explicit VideoFrame(const AVFrame* frame);
+    ~VideoFrame();
+    VideoFrame(const VideoFrame&) = delete;
+    VideoFrame& operator=(const VideoFrame&) = delete;
+
+    // 第plane个平面的数据和行跨度（字节）
+    const uint8_t* data(int plane)const;
+    int linesize(int plane)const;
+    int getWidth() const;
+    int getHeight() const;
+    // AVPixelFormat
+    int format() const;
+    const AVFrame* avFrame() const;
+private:
+    AVFrame* frame_ = nullptr;
+};
+
+Q_DECLARE_METATYPE(std::shared_ptr<VideoFrame>)
+
+#endif // VIDEOFRAME_H
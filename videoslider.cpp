@@ -1,11 +1,22 @@
 #include "videoslider.h"
 #include <QDebug>
 #include <QStyle>
+#include <algorithm>
 
 VideoSlider::VideoSlider(QWidget *parent):
     QSlider(Qt::Horizontal,parent)
 {
+    // 不按键时也接收鼠标移动事件，用于悬停预览
+    setMouseTracking(true);
+}
 
+double VideoSlider::posFromX(int x) const
+{
+    int handleWidth = style()->pixelMetric(QStyle::PM_SliderLength, nullptr, this);
+    int span = width() - handleWidth;
+    if(span <= 0)
+        return 0.0;
+    return std::clamp((x - handleWidth/2) / static_cast<double>(span),0.0,1.0);
 }
 
 void VideoSlider::mousePressEvent(QMouseEvent *event)
@@ -25,3 +36,15 @@ void VideoSlider::mousePressEvent(QMouseEvent *event)
     }
     QSlider::mousePressEvent(event);
 }
+
+void VideoSlider::mouseMoveEvent(QMouseEvent *event)
+{
+    emit hoverMoved(posFromX(event->pos().x()),event->pos().x());
+    QSlider::mouseMoveEvent(event);
+}
+
+void VideoSlider::leaveEvent(QEvent *event)
+{
+    emit hoverLeft();
+    QSlider::leaveEvent(event);
+}
@@ -10,8 +10,19 @@ class VideoSlider : public QSlider
 public:
     explicit VideoSlider(QWidget* parent = nullptr);
 
+    // 滑块坐标x对应的进度（0~1）
+    double posFromX(int x) const;
+
+signals:
+    // 鼠标悬停位置改变，pos为进度（0~1），x为悬停点的控件坐标
+    void hoverMoved(double pos, int x);
+    // 鼠标离开进度条
+    void hoverLeft();
+
 protected:
     void mousePressEvent(QMouseEvent *event)override;
+    void mouseMoveEvent(QMouseEvent *event)override;
+    void leaveEvent(QEvent *event)override;
 
 };
 
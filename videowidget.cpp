@@ -1,9 +1,20 @@
 #include "videowidget.h"
 
+#include <cstring>
+#include <algorithm>
+
+extern "C"{
+#include <libavutil/frame.h>
+}
+
 VideoWidget::VideoWidget(QWidget *parent)
     : QOpenGLWidget{parent},texY(0),texU(0),texV(0)
+    , bufferPool_(std::make_shared<UploadBufferPool>())
 {
     connect(this,&VideoWidget::setFrame,this,&VideoWidget::slotSetFrame,Qt::QueuedConnection);
+    // 调度器与控件同在GUI线程，选中的帧直接设置
+    scheduler_ = new PresentScheduler(this);
+    connect(scheduler_,&PresentScheduler::present,this,&VideoWidget::slotSetFrame);
 }
 
 static const char* vShaderSrc =
@@ -14,27 +25,57 @@ static const char* vShaderSrc =
     "   gl_Position = vertexIn;    \n"
     "   texCoord = textureIn;      \n"
     "}";
+// 片段着色器按格式拼接宏定义生成变体：
+// SEMI_PLANAR表示UV交错存放在texU的rg通道，FULL_RANGE表示取值为全范围；
+// 高位深格式用16位纹理上传，sampleScale把采样值换算到8位格式的尺度
 static const char *fShaderSrc =
     "varying vec2 texCoord;        \n"
     "uniform sampler2D texY;       \n"
     "uniform sampler2D texU;       \n"
     "uniform sampler2D texV;       \n"
+    "uniform float sampleScale;    \n"
     "void main(void) {             \n"
     "   float y = texture2D(texY, texCoord).r; \n"
-    "   float u = texture2D(texU, texCoord).r - 0.5; \n"
-    "   float v = texture2D(texV, texCoord).r - 0.5; \n"
-    "   float r = y + 1.402 * v;   \n"
-    "   float g = y - 0.344 * u - 0.714 * v; \n"
-    "   float b = y + 1.772 * u;   \n"
+    "#ifdef SEMI_PLANAR            \n"
+    "   vec2 uv = texture2D(texU, texCoord).rg; \n"
+    "#else                         \n"
+    "   vec2 uv = vec2(texture2D(texU, texCoord).r, texture2D(texV, texCoord).r); \n"
+    "#endif                        \n"
+    "   y *= sampleScale;          \n"
+    "   uv *= sampleScale;         \n"
+    "#ifdef FULL_RANGE             \n"
+    "   uv -= 0.5;                 \n"
+    "#else                         \n"
+    "   y = (y - 16.0 / 255.0) * (255.0 / 219.0); \n"
+    "   uv = (uv - 128.0 / 255.0) * (255.0 / 224.0); \n"
+    "#endif                        \n"
+    "   float r = y + 1.402 * uv.y; \n"
+    "   float g = y - 0.344 * uv.x - 0.714 * uv.y; \n"
+    "   float b = y + 1.772 * uv.x; \n"
     "   gl_FragColor = vec4(r,g,b,1.0);\n"
     "}";
 
+static int shaderVariant(const PixelFormatInfo& info)
+{
+    return (info.layout == PlaneLayout::SemiPlanar ? 2 : 0) + (info.fullRange ? 1 : 0);
+}
+
 VideoWidget::~VideoWidget()
 {
     makeCurrent();
+    // 先释放当前帧，让它占用的缓冲回到池中
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        frame_.reset();
+    }
+    bufferPool_->releaseGL();
+    for(auto& program : programs_)
+        program.reset();
     glDeleteTextures(1,&texY);
     glDeleteTextures(1,&texU);
     glDeleteTextures(1,&texV);
+    if(uploadRing_[0])
+        glDeleteBuffers(kUploadRingSize,uploadRing_);
     doneCurrent();
 }
 
@@ -49,9 +90,10 @@ void VideoWidget::setAspectRatioMode(int mode)
 }
 
 
-void VideoWidget::slotSetFrame(std::shared_ptr<Yuv420PFrame> frame) {
+void VideoWidget::slotSetFrame(std::shared_ptr<VideoFrame> frame) {
     if (frame == nullptr) {
         // 实现stop时设置opengl界面为黑色
+        scheduler_->flush();
         width_ = height_ = 0;
         aspectRatio_ = 0.0f;
         update();
@@ -61,6 +103,7 @@ void VideoWidget::slotSetFrame(std::shared_ptr<Yuv420PFrame> frame) {
     {
         std::lock_guard<std::mutex> lock(mtx_);
         frame_ = frame;
+        ++frameGeneration_;
     }
 
     width_ = frame_->getWidth();
@@ -76,16 +119,217 @@ void VideoWidget::slotSetFrame(std::shared_ptr<Yuv420PFrame> frame) {
     update(); // 触发重绘
 }
 
+QOpenGLShaderProgram *VideoWidget::programFor(const PixelFormatInfo &info)
+{
+    // 着色器变体在第一次遇到对应格式时编译
+    int variant = shaderVariant(info);
+    std::unique_ptr<QOpenGLShaderProgram>& program = programs_[variant];
+    if(!program){
+        QByteArray src;
+        if(info.layout == PlaneLayout::SemiPlanar)
+            src += "#define SEMI_PLANAR\n";
+        if(info.fullRange)
+            src += "#define FULL_RANGE\n";
+        src += fShaderSrc;
+        program = std::make_unique<QOpenGLShaderProgram>();
+        program->addShaderFromSourceCode(QOpenGLShader::Vertex,vShaderSrc);
+        program->addShaderFromSourceCode(QOpenGLShader::Fragment,src);
+        program->link();
+    }
+    return program.get();
+}
+
 void VideoWidget::initializeGL()
 {
     initializeOpenGLFunctions();
-    program.addShaderFromSourceCode(QOpenGLShader::Vertex,vShaderSrc);
-    program.addShaderFromSourceCode(QOpenGLShader::Fragment,fShaderSrc);
-    program.link();
 
     glGenTextures(1,&texY);
     glGenTextures(1,&texU);
     glGenTextures(1,&texV);
+
+    // 不可变纹理需要GL 4.2、ARB_texture_storage或GLES 3
+    QOpenGLContext* ctx = context();
+    QSurfaceFormat fmt = ctx->format();
+    bool gl3 = fmt.majorVersion() >= 3;
+    if(gl3){
+        extra_ = ctx->extraFunctions();
+        texStorage_ = ctx->isOpenGLES()
+                          || fmt.majorVersion() > 4 || (fmt.majorVersion() == 4 && fmt.minorVersion() >= 2)
+                          || ctx->hasExtension("GL_ARB_texture_storage");
+        glGenBuffers(kUploadRingSize,uploadRing_);
+    }
+    // GL_R16/GL_RG16在桌面GL 3.0起为核心格式，GLES 3中需要EXT_texture_norm16
+    norm16_ = ctx->isOpenGLES() ? ctx->hasExtension("GL_EXT_texture_norm16")
+                                : gl3 || ctx->hasExtension("GL_ARB_texture_rg");
+
+    bufferPool_->initGL(ctx);
+}
+
+void VideoWidget::allocateTextures(const TextureSpec &spec)
+{
+    // 不可变纹理不能改变尺寸，规格变化时整体重建
+    glDeleteTextures(1,&texY);
+    glDeleteTextures(1,&texU);
+    glDeleteTextures(1,&texV);
+    glGenTextures(1,&texY);
+    glGenTextures(1,&texU);
+    glGenTextures(1,&texV);
+
+    bool wide = spec.bytesPerComponent == 2;
+    bool semi = spec.layout == PlaneLayout::SemiPlanar;
+    auto allocate = [&](GLuint tex, int w, int h, bool rg){
+        GLenum format = rg ? GL_RG : GL_RED;
+        GLenum internalFormat = wide ? (rg ? GL_RG16 : GL_R16) : (rg ? GL_RG8 : GL_R8);
+        // GLES 2没有带尺寸的内部格式
+        if(!extra_ && !wide)
+            internalFormat = format;
+        glBindTexture(GL_TEXTURE_2D,tex);
+        if(texStorage_)
+            extra_->glTexStorage2D(GL_TEXTURE_2D,1,internalFormat,w,h);
+        else
+            glTexImage2D(GL_TEXTURE_2D,0,internalFormat,w,h,0,format,wide ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE,nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+    allocate(texY, spec.width, spec.height, false);
+    allocate(texU, spec.chromaW, spec.chromaH, semi);
+    if(!semi)
+        allocate(texV, spec.chromaW, spec.chromaH, false);
+    texSpec_ = spec;
+}
+
+bool VideoWidget::fillUploadRing(const int rows[3], int planes, const void *offsets[3])
+{
+    if(!uploadRing_[0])
+        return false;
+    // 各平面按64字节对齐依次放入PBO，保留原始行跨度
+    size_t offset[3] = {};
+    size_t size = 0;
+    for(int i = 0; i < planes; ++i){
+        offset[i] = size;
+        size += (static_cast<size_t>(frame_->linesize(i)) * rows[i] + 63) & ~static_cast<size_t>(63);
+    }
+
+    GLuint pbo = uploadRing_[uploadRingIndex_];
+    uploadRingIndex_ = (uploadRingIndex_ + 1) % kUploadRingSize;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    // 重新指定存储让驱动分配新的内存，GPU仍在读取的旧内容不会导致等待
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_DRAW);
+    void* dst = extra_->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(size),
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if(!dst){
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+    for(int i = 0; i < planes; ++i){
+        memcpy(static_cast<uint8_t*>(dst) + offset[i], frame_->data(i), static_cast<size_t>(frame_->linesize(i)) * rows[i]);
+        offsets[i] = reinterpret_cast<const void*>(static_cast<uintptr_t>(offset[i]));
+    }
+    extra_->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return true;
+}
+
+void VideoWidget::narrowPlanes(const PixelFormatInfo &info, const TextureSpec &spec, int planes,
+                               const void *src[3], int rowLength[3])
+{
+    // 各平面每行的分量数
+    bool semi = spec.layout == PlaneLayout::SemiPlanar;
+    int widths[3] = {spec.width, spec.chromaW * (semi ? 2 : 1), spec.chromaW};
+    int rows[3] = {spec.height, spec.chromaH, spec.chromaH};
+    size_t offset[3] = {};
+    size_t size = 0;
+    for(int i = 0; i < planes; ++i){
+        offset[i] = size;
+        size += static_cast<size_t>(widths[i]) * rows[i];
+    }
+    if(narrowBuf_.size() < size)
+        narrowBuf_.resize(size);
+
+    int shift = info.narrowShift();
+    for(int i = 0; i < planes; ++i){
+        const uint8_t* plane = frame_->data(i);
+        uint8_t* dst = narrowBuf_.data() + offset[i];
+        for(int y = 0; y < rows[i]; ++y){
+            const uint16_t* line = reinterpret_cast<const uint16_t*>(plane + static_cast<size_t>(frame_->linesize(i)) * y);
+            uint8_t* out = dst + static_cast<size_t>(widths[i]) * y;
+            for(int x = 0; x < widths[i]; ++x)
+                out[x] = static_cast<uint8_t>(std::min(line[x] >> shift,255));
+        }
+        src[i] = dst;
+        rowLength[i] = widths[i];
+    }
+}
+
+void VideoWidget::uploadFrame(const PixelFormatInfo &info)
+{
+    // 直接从解码器缓冲区上传，按行跨度跳过每行末尾的对齐填充
+    TextureSpec spec;
+    spec.width = width_;
+    spec.height = height_;
+    spec.chromaW = -((-width_) >> info.chromaShiftW);
+    spec.chromaH = -((-height_) >> info.chromaShiftH);
+    spec.layout = info.layout;
+    spec.bytesPerComponent = info.bytesPerComponent();
+    // 不支持16位归一化纹理（GLES 3缺少EXT_texture_norm16）时截为8位纹理
+    bool narrow = spec.bytesPerComponent == 2 && !norm16_;
+    if(narrow)
+        spec.bytesPerComponent = 1;
+    if(!(spec == texSpec_))
+        allocateTextures(spec);
+
+    bool semi = info.layout == PlaneLayout::SemiPlanar;
+    int planes = semi ? 2 : 3;
+    int rows[3] = {spec.height, spec.chromaH, spec.chromaH};
+    const void* src[3] = {};
+    // 各平面的行长度（分量数），为0时按帧的行跨度计算
+    int rowLength[3] = {};
+
+    // 帧由缓冲池分配时直接从其PBO上传，否则先拷贝进上传环；数据指针换成相对PBO起点的偏移
+    UploadBufferPool::Region region;
+    bool fromPool = bufferPool_->locate(frame_->avFrame(), region);
+    bool fromRing = false;
+    if(narrow){
+        // 在CPU上逐样本右移后从暂存缓冲上传，不经过PBO
+        narrowPlanes(info, spec, planes, src, rowLength);
+    }else if(fromPool){
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, region.pbo);
+        for(int i = 0; i < planes; ++i)
+            src[i] = reinterpret_cast<const void*>(static_cast<uintptr_t>(frame_->data(i) - region.base));
+    }else{
+        fromRing = fillUploadRing(rows, planes, src);
+        if(!fromRing){
+            for(int i = 0; i < planes; ++i)
+                src[i] = frame_->data(i);
+        }
+    }
+
+    GLenum type = spec.bytesPerComponent == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    auto uploadPlane = [&](GLuint tex, int plane, int w, int h, GLenum format, int components){
+        glBindTexture(GL_TEXTURE_2D,tex);
+        // 行长度以像素计
+        int length = rowLength[plane] ? rowLength[plane] : frame_->linesize(plane) / spec.bytesPerComponent;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, length / components);
+        glTexSubImage2D(GL_TEXTURE_2D,0,0,0,w,h,format,type,src[plane]);
+    };
+    // 上传y
+    uploadPlane(texY, 0, spec.width, spec.height, GL_RED, 1);
+    if(semi){
+        // 上传交错的uv
+        uploadPlane(texU, 1, spec.chromaW, spec.chromaH, GL_RG, 2);
+    }else{
+        // 上传u、v
+        uploadPlane(texU, 1, spec.chromaW, spec.chromaH, GL_RED, 1);
+        uploadPlane(texV, 2, spec.chromaW, spec.chromaH, GL_RED, 1);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    if((fromPool && !narrow) || fromRing)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if(fromPool)
+        bufferPool_->markUploaded(region.slot);
 }
 
 void VideoWidget::resizeGL(int w, int h)
@@ -104,51 +348,46 @@ void VideoWidget::paintGL()
     if(width_ == 0 || height_ == 0)
         return;
 
-    program.bind();
-
     std::lock_guard<std::mutex> lock(mtx_);
-    // 上传y
-    glActiveTexture(GL_TEXTURE0);   // 激活纹理单元0
+    PixelFormatInfo info;
+    if(!lookupPixelFormat(frame_->format(), info))
+        return;
+    // 码流标记为全范围的普通YUV格式同样按全范围解释
+    if(frame_->avFrame()->color_range == AVCOL_RANGE_JPEG)
+        info.fullRange = true;
+    QOpenGLShaderProgram* program = programFor(info);
+    program->bind();
+
+    bufferPool_->maintain();
+    // 同一帧只上传一次，之后的重绘直接使用纹理
+    if(uploadedGeneration_ != frameGeneration_){
+        uploadFrame(info);
+        uploadedGeneration_ = frameGeneration_;
+    }
+    glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D,texY);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RED,width_,height_,0,GL_RED,GL_UNSIGNED_BYTE, frame_->yPlane());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    // 上传u
-    glActiveTexture(GL_TEXTURE1);   // 激活纹理单元1
+    glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D,texU);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RED,width_/2,height_/2,0,GL_RED,GL_UNSIGNED_BYTE, frame_->uPlane());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    // 上传v
-    glActiveTexture(GL_TEXTURE2);   // 激活纹理单元2
+    glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D,texV);
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RED,width_/2,height_/2,0,GL_RED,GL_UNSIGNED_BYTE, frame_->vPlane());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    program.setUniformValue("texY", 0);
-    program.setUniformValue("texU", 1);
-    program.setUniformValue("texV", 2);
+    program->setUniformValue("texY", 0);
+    program->setUniformValue("texU", 1);
+    program->setUniformValue("texV", 2);
+    // 截为8位上传时已是8位格式的尺度
+    program->setUniformValue("sampleScale", texSpec_.bytesPerComponent == 2 ? info.sampleScale() : 1.0f);
 
     // 使用计算好的顶点坐标
-    program.enableAttributeArray("vertexIn");
-    program.setAttributeArray("vertexIn", GL_FLOAT, vertices_, 2);
-    program.enableAttributeArray("textureIn");
-    program.setAttributeArray("textureIn", GL_FLOAT, texCoords_, 2);
+    program->enableAttributeArray("vertexIn");
+    program->setAttributeArray("vertexIn", GL_FLOAT, vertices_, 2);
+    program->enableAttributeArray("textureIn");
+    program->setAttributeArray("textureIn", GL_FLOAT, texCoords_, 2);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-    program.disableAttributeArray("vertexIn");
-    program.disableAttributeArray("textureIn");
-    program.release();
+    program->disableAttributeArray("vertexIn");
+    program->disableAttributeArray("textureIn");
+    program->release();
 
 }
 
@@ -3,11 +3,16 @@
 
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLShaderProgram>
 #include <QBoxLayout>
 #include <memory>
 #include <mutex>
-#include "yuv420pframe.h"
+#include <vector>
+#include "videoframe.h"
+#include "uploadbufferpool.h"
+#include "pixelformat.h"
+#include "presentscheduler.h"
 
 
 class VideoWidget : public QOpenGLWidget ,protected QOpenGLFunctions
@@ -28,12 +33,17 @@ public:
     void setAspectRatioMode(int mode);
     AspectRatioMode aspectRatioMode() const { return aspectRatioMode_; }
 
+    // 解码器输出缓冲池，解码器直接写入可上传的缓冲区
+    std::shared_ptr<UploadBufferPool> bufferPool() const { return bufferPool_; }
+    // 按vsync节奏送显的调度器
+    PresentScheduler* presentScheduler() const { return scheduler_; }
+
 
 
 signals:
-    void setFrame(std::shared_ptr<Yuv420PFrame> frame);
+    void setFrame(std::shared_ptr<VideoFrame> frame);
 private slots:
-void slotSetFrame(std::shared_ptr<Yuv420PFrame> frame);
+void slotSetFrame(std::shared_ptr<VideoFrame> frame);
     // QOpenGLWidget interface
 protected:
     void initializeGL();
@@ -42,11 +52,50 @@ protected:
 private:
     // 更新顶点坐标
     void updateVertices();
+    // 获取格式对应的着色器变体，首次使用时编译
+    QOpenGLShaderProgram* programFor(const PixelFormatInfo& info);
+
+    // 纹理存储规格，变化时重新分配纹理
+    struct TextureSpec{
+        int width = 0, height = 0;
+        int chromaW = 0, chromaH = 0;
+        PlaneLayout layout = PlaneLayout::Planar;
+        int bytesPerComponent = 1;
+        bool operator==(const TextureSpec& o) const {
+            return width == o.width && height == o.height && chromaW == o.chromaW && chromaH == o.chromaH
+                   && layout == o.layout && bytesPerComponent == o.bytesPerComponent;
+        }
+    };
+    // 按规格重建纹理，支持时使用不可变存储
+    void allocateTextures(const TextureSpec& spec);
+    // 把当前帧上传到纹理，需持有mtx_
+    void uploadFrame(const PixelFormatInfo& info);
+    // 把当前帧的16位平面右移截为8位写入暂存缓冲，返回各平面的数据指针和行长度（分量数）
+    void narrowPlanes(const PixelFormatInfo& info, const TextureSpec& spec, int planes,
+                      const void* src[3], int rowLength[3]);
+    // 把不在缓冲池中的帧拷贝进上传环的下一个PBO，返回各平面在PBO中的偏移
+    bool fillUploadRing(const int rows[3], int planes, const void* offsets[3]);
 
-    QOpenGLShaderProgram program;
+    // 着色器变体：平面布局 x 取值范围
+    std::unique_ptr<QOpenGLShaderProgram> programs_[4];
     GLuint texY, texU,texV;
+    TextureSpec texSpec_;
+    bool texStorage_ = false;   // 是否支持glTexStorage2D
+    bool norm16_ = false;       // 是否支持GL_R16/GL_RG16，不支持时高位深格式截为8位上传
+    // 截为8位时的暂存缓冲，各平面紧密排列
+    std::vector<uint8_t> narrowBuf_;
+    QOpenGLExtraFunctions* extra_ = nullptr;
+    // 上传环：轮流使用的PBO，glTexSubImage2D从PBO异步读取，不阻塞渲染线程
+    static constexpr int kUploadRingSize = 3;
+    GLuint uploadRing_[kUploadRingSize] = {};
+    int uploadRingIndex_ = 0;
+    // 帧代数，每收到一帧加一；与已上传的代数相同时（缩放、切换比例引起的重绘）跳过上传
+    uint64_t frameGeneration_ = 0;
+    uint64_t uploadedGeneration_ = 0;
     int width_ = 0,height_ = 0;
-    std::shared_ptr<Yuv420PFrame> frame_;
+    std::shared_ptr<VideoFrame> frame_;
+    std::shared_ptr<UploadBufferPool> bufferPool_;
+    PresentScheduler* scheduler_ = nullptr;
     std::mutex mtx_;
 
     float aspectRatio_ = 0.0f;  // 存储视频的原始宽高比
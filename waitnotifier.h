@@ -0,0 +1,92 @@
+#ifndef WAITNOTIFIER_H
+#define WAITNOTIFIER_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+
+// 轻量级等待/唤醒原语（event count）
+// 等待方先无锁检查条件，条件不满足才挂起到条件变量上；
+// 通知方只有在确实有线程挂起时才去获取互斥锁，
+// 因此在无人等待的快路径上只有一次原子读。
+class WaitNotifier{
+public:
+    // 阻塞直到pred()为true
+    template<typename Pred>
+    void wait(Pred pred){
+        if(pred())
+            return;
+        std::unique_lock<std::mutex> lock(mtx_);
+        // 先登记等待者，再检查条件，与notify中的fence配对，避免丢失唤醒
+        waiters_.fetch_add(1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while(!pred()){
+            cv_.wait(lock);
+            wakeups_.fetch_add(1,std::memory_order_relaxed);
+        }
+        waiters_.fetch_sub(1,std::memory_order_relaxed);
+    }
+
+    // 带超时的等待，返回pred()的最终结果
+    template<typename Rep,typename Period,typename Pred>
+    bool waitFor(const std::chrono::duration<Rep,Period>& timeout,Pred pred){
+        if(pred())
+            return true;
+        std::unique_lock<std::mutex> lock(mtx_);
+        waiters_.fetch_add(1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto deadline = std::chrono::steady_clock::now()
+                        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        bool ok = pred();
+        while(!ok){
+            std::cv_status st = cv_.wait_until(lock,deadline);
+            wakeups_.fetch_add(1,std::memory_order_relaxed);
+            ok = pred();
+            if(st == std::cv_status::timeout)
+                break;
+        }
+        waiters_.fetch_sub(1,std::memory_order_relaxed);
+        return ok;
+    }
+
+    // 唤醒所有等待者，调用前需已修改好条件相关的状态
+    void notify(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiters_.load(std::memory_order_relaxed) == 0)
+            return;
+        {
+            // 加锁保证等待方要么还没检查条件，要么已经进入wait
+            std::lock_guard<std::mutex> lock(mtx_);
+        }
+        cv_.notify_all();
+    }
+
+    // 不会阻塞的通知，供音频回调等实时线程使用
+    // 拿不到锁说明等待方正处于检查条件和挂起之间，此时放弃本次通知，
+    // 只适用于通知方会周期性调用、丢失的唤醒能由下一次调用补上的场景
+    void tryNotify(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiters_.load(std::memory_order_relaxed) == 0)
+            return;
+        std::unique_lock<std::mutex> lock(mtx_,std::try_to_lock);
+        if(!lock.owns_lock())
+            return;
+        lock.unlock();
+        cv_.notify_all();
+    }
+
+    // 挂起的线程被唤醒的累计次数（含超时与虚假唤醒），用于统计空闲时的唤醒频率
+    uint64_t wakeups()const{
+        return wakeups_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::atomic<int> waiters_{0};
+    std::atomic<uint64_t> wakeups_{0};
+};
+
+#endif // WAITNOTIFIER_H